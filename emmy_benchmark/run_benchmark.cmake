@@ -0,0 +1,68 @@
+# 对每个内置的lua 版本分别配置、编译并运行 emmy_benchmark, 结果合并到一个 jsonl 文件
+# 用法:
+#   cmake [-DBENCHMARK_BUILD_DIR=dir] [-DBENCHMARK_OUTPUT=file] [-DBENCHMARK_REPEAT=3] -P emmy_benchmark/run_benchmark.cmake
+# luajit 目录只有说明文件, 没有可以编译的源码, 所以不在列表中
+
+cmake_minimum_required(VERSION 3.14)
+
+get_filename_component(EMMY_ROOT "${CMAKE_CURRENT_LIST_DIR}/.." ABSOLUTE)
+
+if(NOT BENCHMARK_BUILD_DIR)
+    set(BENCHMARK_BUILD_DIR "${CMAKE_CURRENT_BINARY_DIR}/emmy_benchmark_build")
+endif()
+if(NOT BENCHMARK_OUTPUT)
+    set(BENCHMARK_OUTPUT "${BENCHMARK_BUILD_DIR}/benchmark.jsonl")
+endif()
+if(NOT BENCHMARK_REPEAT)
+    set(BENCHMARK_REPEAT 3)
+endif()
+
+set(BENCHMARK_LUA_VERSIONS 51 52 53 54)
+
+file(WRITE "${BENCHMARK_OUTPUT}" "")
+
+foreach(version ${BENCHMARK_LUA_VERSIONS})
+    set(build_dir "${BENCHMARK_BUILD_DIR}/lua${version}")
+    message(STATUS "emmy_benchmark: lua ${version}")
+
+    execute_process(
+        COMMAND ${CMAKE_COMMAND} -S "${EMMY_ROOT}" -B "${build_dir}"
+            -DCMAKE_BUILD_TYPE=Release
+            -DEMMY_LUA_VERSION=${version}
+            -DEMMY_USE_LUA_SOURCE=ON
+            -DEMMY_BUILD_BENCHMARK=ON
+        RESULT_VARIABLE result
+    )
+    if(result)
+        message(FATAL_ERROR "configure lua ${version} failed")
+    endif()
+
+    execute_process(
+        COMMAND ${CMAKE_COMMAND} --build "${build_dir}" --config Release --target emmy_benchmark
+        RESULT_VARIABLE result
+    )
+    if(result)
+        message(FATAL_ERROR "build lua ${version} failed")
+    endif()
+
+    file(GLOB_RECURSE benchmark_exe
+        "${build_dir}/emmy_benchmark/emmy_benchmark"
+        "${build_dir}/emmy_benchmark/emmy_benchmark.exe"
+    )
+    if(NOT benchmark_exe)
+        message(FATAL_ERROR "emmy_benchmark not found in ${build_dir}")
+    endif()
+    list(GET benchmark_exe 0 benchmark_exe)
+
+    execute_process(
+        COMMAND "${benchmark_exe}" ${BENCHMARK_REPEAT}
+        OUTPUT_VARIABLE output
+        RESULT_VARIABLE result
+    )
+    if(result)
+        message(FATAL_ERROR "run lua ${version} failed")
+    endif()
+    file(APPEND "${BENCHMARK_OUTPUT}" "${output}")
+endforeach()
+
+message(STATUS "emmy_benchmark: results written to ${BENCHMARK_OUTPUT}")
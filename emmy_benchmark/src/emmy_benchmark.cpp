@@ -0,0 +1,350 @@
+﻿/*
+* Copyright (c) 2019. tangzx(love.tangzx@qq.com)
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+// hook 开销基准测试
+// 在各个状态机和断点配置下运行同一组lua 负载, 每个结果输出一行json:
+// {"lua", "workload", "state", "breakpoints", "iterations", "lineEvents", "ns", "baselineNs", "nsPerLineEvent", "slowdown"}
+// 用法: emmy_benchmark [repeat]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include "nlohmann/json.hpp"
+#include "emmy_debugger/emmy_facade.h"
+#include "emmy_debugger/debugger/emmy_debugger.h"
+
+struct Workload {
+	const char* name;
+	const char* code;
+	// 条件断点所在的热点行和条件, 条件总是为false
+	int hotLine;
+	const char* condition;
+};
+
+// 每个负载的第2行都在一个不会被调用的函数里, 用作不会命中的断点
+static const Workload workloads[] = {
+	{
+		"fib",
+		"local function unused()\n"
+		"	return 0\n"
+		"end\n"
+		"local function fib(n)\n"
+		"	if n < 2 then\n"
+		"		return n\n"
+		"	end\n"
+		"	return fib(n - 1) + fib(n - 2)\n"
+		"end\n"
+		"return function()\n"
+		"	return fib(18)\n"
+		"end\n",
+		5, "n < 0"
+	},
+	{
+		"table_churn",
+		"local function unused()\n"
+		"	return 0\n"
+		"end\n"
+		"return function()\n"
+		"	local list = {}\n"
+		"	for i = 1, 2000 do\n"
+		"		local item = { id = i, name = 'item', value = i * 2 }\n"
+		"		list[#list + 1] = item\n"
+		"	end\n"
+		"	local sum = 0\n"
+		"	for i = 1, #list do\n"
+		"		sum = sum + list[i].value\n"
+		"	end\n"
+		"	return sum\n"
+		"end\n",
+		7, "i < 0"
+	},
+	{
+		"string_ops",
+		"local function unused()\n"
+		"	return 0\n"
+		"end\n"
+		"return function()\n"
+		"	local parts = {}\n"
+		"	for i = 1, 500 do\n"
+		"		local s = string.format('%d:%s', i, string.rep('x', i % 16))\n"
+		"		parts[#parts + 1] = string.upper(s):sub(1, 8)\n"
+		"	end\n"
+		"	return table.concat(parts, ',')\n"
+		"end\n",
+		7, "i < 0"
+	},
+	{
+		"coroutine_ping_pong",
+		"local function unused()\n"
+		"	return 0\n"
+		"end\n"
+		"return function()\n"
+		"	local co = coroutine.wrap(function(v)\n"
+		"		while true do\n"
+		"			v = coroutine.yield(v + 1)\n"
+		"		end\n"
+		"	end)\n"
+		"	local v = 0\n"
+		"	for i = 1, 2000 do\n"
+		"		v = co(v)\n"
+		"	end\n"
+		"	return v\n"
+		"end\n",
+		7, "v < 0"
+	},
+};
+
+enum class BreakpointMode {
+	None,
+	// 断点在同一个文件中但不会执行到
+	Cold,
+	// 热点行上的条件断点, 条件不成立
+	Conditional,
+};
+
+static const char* BreakpointModeName(BreakpointMode mode) {
+	switch (mode) {
+		case BreakpointMode::None:
+			return "none";
+		case BreakpointMode::Cold:
+			return "cold";
+		case BreakpointMode::Conditional:
+			return "conditional";
+	}
+	return "";
+}
+
+struct HookMode {
+	const char* name;
+	DebugAction action;
+};
+
+// Break 和 StepIn 在第一个新行就会中断, 没有可以测量的稳定状态
+// Stop 启动后立即切换为 Continue, 与 Continue 相同
+static const HookMode hookModes[] = {
+	{"Continue", DebugAction::Continue},
+	{"StepOver", DebugAction::StepOver},
+	{"StepOut", DebugAction::StepOut},
+};
+
+struct BenchRun {
+	std::shared_ptr<Debugger> debugger;
+	// DebugAction::None 表示不设置hook
+	DebugAction action = DebugAction::None;
+	int iterations = 1;
+	long long ns = 0;
+};
+
+static BenchRun* currentRun = nullptr;
+
+// upvalue 1 是负载函数
+// 状态机在这个C 函数里启动, 单步的起始深度停在这一层, 负载总在更深的栈上执行, 不会中断
+static int RunWorkload(lua_State* L) {
+	auto run = currentRun;
+	if (run->action != DebugAction::None) {
+		run->debugger->SetCurrentState(L);
+		run->debugger->DoAction(run->action);
+		run->debugger->UpdateHookMask(L);
+	}
+
+	const auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < run->iterations; i++) {
+		lua_pushvalue(L, lua_upvalueindex(1));
+		lua_call(L, 0, 0);
+	}
+	const auto end = std::chrono::steady_clock::now();
+	run->ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+
+	if (run->action != DebugAction::None) {
+		run->debugger->DoAction(DebugAction::Continue);
+	}
+	return 0;
+}
+
+static long long lineEventCount = 0;
+
+static void CountLineHook(lua_State*, lua_Debug*) {
+	lineEventCount++;
+}
+
+class Benchmark {
+public:
+	explicit Benchmark(int repeat)
+		: repeat(repeat), L(nullptr) {
+	}
+
+	bool Run() {
+		L = luaL_newstate();
+		luaL_openlibs(L);
+
+		auto& manager = EmmyFacade::Get().GetDebugManager();
+		debugger = manager.AddDebugger(L);
+		debugger->Start();
+
+		bool suc = true;
+		for (auto& workload: workloads) {
+			if (!RunWorkloadModes(workload)) {
+				suc = false;
+				break;
+			}
+		}
+
+		lua_sethook(L, nullptr, 0, 0);
+		manager.RemoveAllBreakpoints();
+		manager.RemoveDebugger(L);
+		debugger = nullptr;
+		lua_close(L);
+		return suc;
+	}
+
+private:
+	bool RunWorkloadModes(const Workload& workload) {
+		const std::string chunkName = std::string("bench/") + workload.name + ".lua";
+		const std::string code = workload.code;
+		if (luaL_loadbuffer(L, code.c_str(), code.size(), ("@" + chunkName).c_str()) != LUA_OK ||
+			lua_pcall(L, 0, 1, 0) != LUA_OK) {
+			fprintf(stderr, "%s: %s\n", workload.name, lua_tostring(L, -1));
+			lua_pop(L, 1);
+			return false;
+		}
+		// 负载函数作为 RunWorkload 的 upvalue
+		lua_pushcclosure(L, RunWorkload, 1);
+		const int runner = lua_gettop(L);
+
+		const int iterations = Calibrate(runner);
+		const long long lineEvents = CountLineEvents(runner);
+		const long long baselineNs = Measure(runner, DebugAction::None, iterations);
+		Report(workload, "None", BreakpointMode::None, iterations, lineEvents, baselineNs, baselineNs);
+
+		auto& manager = EmmyFacade::Get().GetDebugManager();
+		for (auto mode: {BreakpointMode::None, BreakpointMode::Cold, BreakpointMode::Conditional}) {
+			manager.RemoveAllBreakpoints();
+			if (mode != BreakpointMode::None) {
+				auto bp = std::make_shared<BreakPoint>();
+				bp->file = chunkName;
+				if (mode == BreakpointMode::Cold) {
+					bp->line = 2;
+				} else {
+					bp->line = workload.hotLine;
+					bp->condition = workload.condition;
+				}
+				manager.AddBreakpoint(bp);
+			}
+
+			for (auto& hookMode: hookModes) {
+				const long long ns = Measure(runner, hookMode.action, iterations);
+				Report(workload, hookMode.name, mode, iterations, lineEvents, ns, baselineNs);
+			}
+		}
+		manager.RemoveAllBreakpoints();
+
+		lua_settop(L, runner - 1);
+		return true;
+	}
+
+	// 使无hook 时单次测量不少于 10ms
+	int Calibrate(int runner) {
+		int iterations = 1;
+		while (true) {
+			const long long ns = Execute(runner, DebugAction::None, iterations);
+			if (ns >= 10000000LL || iterations >= (1 << 20)) {
+				return iterations;
+			}
+			iterations *= 2;
+		}
+	}
+
+	long long CountLineEvents(int runner) {
+		lineEventCount = 0;
+		lua_sethook(L, CountLineHook, LUA_MASKLINE, 0);
+		Execute(runner, DebugAction::None, 1);
+		lua_sethook(L, nullptr, 0, 0);
+		return lineEventCount;
+	}
+
+	// 取 repeat 次中最快的一次
+	long long Measure(int runner, DebugAction action, int iterations) {
+		long long best = -1;
+		for (int i = 0; i < repeat; i++) {
+			const long long ns = Execute(runner, action, iterations);
+			if (best < 0 || ns < best) {
+				best = ns;
+			}
+		}
+		return best;
+	}
+
+	// action 为 None 时保持当前的hook 不变
+	long long Execute(int runner, DebugAction action, int iterations) {
+		// 负载和启动状态机都在这个 scope 里读取断点索引
+		EmmyDebuggerManager::HookScope scope(EmmyFacade::Get().GetDebugManager());
+		if (action != DebugAction::None) {
+			debugger->DoAction(DebugAction::Continue);
+			debugger->UpdateHook(debugger->GetHookMask(L), L);
+		}
+
+		BenchRun run;
+		run.debugger = debugger;
+		run.action = action;
+		run.iterations = iterations;
+		currentRun = &run;
+		lua_pushvalue(L, runner);
+		if (lua_pcall(L, 0, 0, 0) != LUA_OK) {
+			fprintf(stderr, "%s\n", lua_tostring(L, -1));
+			lua_pop(L, 1);
+		}
+		currentRun = nullptr;
+		if (action != DebugAction::None) {
+			lua_sethook(L, nullptr, 0, 0);
+		}
+		return run.ns;
+	}
+
+	void Report(const Workload& workload, const char* state, BreakpointMode mode, int iterations,
+	            long long lineEvents, long long ns, long long baselineNs) {
+		auto obj = nlohmann::json::object();
+		obj["lua"] = LUA_VERSION;
+		obj["workload"] = workload.name;
+		obj["state"] = state;
+		obj["breakpoints"] = BreakpointModeName(mode);
+		obj["iterations"] = iterations;
+		obj["lineEvents"] = lineEvents;
+		obj["ns"] = ns;
+		obj["baselineNs"] = baselineNs;
+		const double events = static_cast<double>(lineEvents) * iterations;
+		obj["nsPerLineEvent"] = events > 0 ? static_cast<double>(ns - baselineNs) / events : 0.0;
+		obj["slowdown"] = baselineNs > 0 ? static_cast<double>(ns) / baselineNs : 0.0;
+		printf("%s\n", obj.dump().c_str());
+		fflush(stdout);
+	}
+
+	int repeat;
+	lua_State* L;
+	std::shared_ptr<Debugger> debugger;
+};
+
+int main(int argc, char** argv) {
+	int repeat = 3;
+	if (argc > 1) {
+		repeat = std::max(1, atoi(argv[1]));
+	}
+
+	Benchmark benchmark(repeat);
+	return benchmark.Run() ? 0 : 1;
+}
@@ -31,9 +31,20 @@ typedef ptrdiff_t lua_KContext;
 typedef int(*lua_KFunction) (lua_State *L, int status, lua_KContext ctx);
 #endif
 
+#if defined(EMMY_LUA_51) || defined(EMMY_LUA_52) || defined(EMMY_LUA_JIT)
+// 53 之前没有整数子类型
+#ifndef lua_isinteger
+#define lua_isinteger(L,i) 0
+#endif
+#endif
+
 #if defined(EMMY_LUA_51) || defined(EMMY_LUA_JIT)
 #define LUA_OK 0
 
+#ifndef LUA_NUMTAGS
+#define LUA_NUMTAGS 9
+#endif
+
 int lua_absindex(lua_State *L, int idx);
 
 #ifndef EMMY_LUA_JIT_SUPPORT_LUA_SETFUNCS
@@ -52,6 +63,10 @@ void luaL_setfuncs(lua_State* L, const luaL_Reg* l, int nup);
 
 void lua_pushglobaltable(lua_State* L);
 
+#ifndef lua_rawlen
+#define lua_rawlen(L,i) lua_objlen(L, (i))
+#endif
+
 #endif
 
 inline int getDebugEvent(lua_Debug* ar) {
@@ -66,6 +81,14 @@ inline const char* getDebugName(lua_Debug* ar) {
 	return ar->name;
 }
 
+inline int getDebugLineDefined(lua_Debug* ar) {
+	return ar->linedefined;
+}
+
+inline int getDebugLastLineDefined(lua_Debug* ar) {
+	return ar->lastlinedefined;
+}
+
 inline const char* getDebugSource(lua_Debug* ar) {
 	return ar->source;
 }
@@ -195,6 +195,7 @@ struct lua_Debug {
 int getDebugEvent(lua_Debug* ar);
 int getDebugCurrentLine(lua_Debug* ar);
 int getDebugLineDefined(lua_Debug* ar);
+int getDebugLastLineDefined(lua_Debug* ar);
 const char* getDebugSource(lua_Debug* ar);
 const char* getDebugName(lua_Debug* ar);
 
@@ -296,12 +297,16 @@ typedef int (*dll_lua_getinfo)(lua_State* L, const char* what, lua_Debug* ar);
 DEF_LUA_API(lua_getinfo);
 typedef const char*(*dll_lua_getlocal)(lua_State* L, const lua_Debug* ar, int n);
 DEF_LUA_API(lua_getlocal);
+typedef const char*(*dll_lua_setlocal)(lua_State* L, const lua_Debug* ar, int n);
+DEF_LUA_API(lua_setlocal);
 typedef const char*(*dll_lua_getupvalue)(lua_State* L, int funcindex, int n);
 DEF_LUA_API(lua_getupvalue);
 typedef const char*(*dll_lua_setupvalue)(lua_State* L, int funcindex, int n);
 DEF_LUA_API(lua_setupvalue);
 typedef void (*dll_lua_sethook)(lua_State* L, lua_Hook func, int mask, int count);
 DEF_LUA_API(lua_sethook);
+typedef int (*dll_lua_gethookmask)(lua_State* L);
+DEF_LUA_API(lua_gethookmask);
 typedef int (*dll_luaL_loadstring)(lua_State* L, const char* s);
 DEF_LUA_API(luaL_loadstring);
 typedef const char*(*dll_luaL_checklstring)(lua_State* L, int arg, size_t* l);
@@ -330,6 +335,12 @@ typedef void (*dll_lua_close)(lua_State* L);
 DEF_LUA_API(lua_close);
 typedef int (*dll_lua_pushthread)(lua_State* L);
 DEF_LUA_API(lua_pushthread);
+typedef lua_State* (*dll_lua_newthread)(lua_State* L);
+DEF_LUA_API(lua_newthread);
+typedef void (*dll_lua_xmove)(lua_State* from, lua_State* to, int n);
+DEF_LUA_API(lua_xmove);
+typedef int (*dll_lua_error)(lua_State* L);
+DEF_LUA_API(lua_error);
 
 //51
 typedef int (*dll_e_lua_setfenv)(lua_State* L, int idx);
@@ -344,6 +355,20 @@ typedef int (*dll_e_lua_pcall)(lua_State* L, int nargs, int nresults, int errfun
 DEF_LUA_API_E(lua_pcall);
 typedef void (*dll_e_lua_insert)(lua_State* L, int idx);
 DEF_LUA_API_E(lua_insert);
+// 各版本参数不同, 同一个符号按各版本的声明分别保存
+typedef int (*dll_e_lua_resume)(lua_State* L, lua_State* from, int narg, int* nres);
+DEF_LUA_API_E(lua_resume);
+typedef int (*dll_e_lua_resume_51)(lua_State* L, int narg);
+DEF_LUA_API_E(lua_resume_51);
+typedef int (*dll_e_lua_resume_52)(lua_State* L, lua_State* from, int narg);
+DEF_LUA_API_E(lua_resume_52);
+// 部分luajit 不支持替换分配器
+typedef lua_Alloc (*dll_e_lua_getallocf)(lua_State* L, void** ud);
+DEF_LUA_API_E(lua_getallocf);
+typedef void (*dll_e_lua_setallocf)(lua_State* L, lua_Alloc f, void* ud);
+DEF_LUA_API_E(lua_setallocf);
+typedef size_t (*dll_e_lua_objlen)(lua_State* L, int idx);
+DEF_LUA_API_E(lua_objlen);
 
 
 //51 & 52
@@ -372,6 +397,8 @@ typedef void(*dll_e_lua_rawsetp)(lua_State* L, int idx, const void* p);
 DEF_LUA_API_E(lua_rawsetp);
 typedef int(*dll_e_lua_pushthread)(lua_State* L);
 DEF_LUA_API_E(lua_pushthread);
+typedef size_t (*dll_e_lua_rawlen)(lua_State* L, int idx);
+DEF_LUA_API_E(lua_rawlen);
 
 // 51 & 52 & 53
 typedef void* (*dll_e_lua_newuserdata)(lua_State* L, int size);
@@ -380,6 +407,10 @@ DEF_LUA_API_E(lua_newuserdata);
 typedef void (*dll_e_lua_rotate)(lua_State *L, int idx, int n);
 DEF_LUA_API_E(lua_rotate);
 
+//53 & 54
+typedef int (*dll_e_lua_isinteger)(lua_State* L, int idx);
+DEF_LUA_API_E(lua_isinteger);
+
 //54
 typedef void* (*dll_e_lua_newuserdatauv)(lua_State* L, int size, int nuvalue);
 DEF_LUA_API_E(lua_newuserdatauv);
@@ -390,6 +421,8 @@ DEF_LUA_API_E(luaopen_jit);
 
 lua_Integer lua_tointeger(lua_State* L, int idx);
 lua_Number lua_tonumber(lua_State* L, int idx);
+// 53 之前的版本没有整数子类型, 总是返回0
+int lua_isinteger(lua_State* L, int idx);
 int lua_setfenv(lua_State* L, int idx);
 int lua_getglobal(lua_State* L, const char* name);
 void lua_setglobal(lua_State* L, const char* name);
@@ -404,3 +437,9 @@ void lua_pushglobaltable(lua_State* L);
 int lua_rawgetp(lua_State* L, int idx, const void* p);
 void lua_rawsetp(lua_State* L, int idx, const void* p);
 void lua_insert(lua_State* L, int idx);
+int lua_resume(lua_State* L, lua_State* from, int narg, int* nres);
+// 不支持时返回 nullptr
+lua_Alloc lua_getallocf(lua_State* L, void** ud);
+void lua_setallocf(lua_State* L, lua_Alloc f, void* ud);
+// 51 使用 lua_objlen
+size_t lua_rawlen(lua_State* L, int idx);
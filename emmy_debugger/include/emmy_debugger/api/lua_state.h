@@ -1,5 +1,8 @@
-﻿
+﻿#pragma once
+
 #include <vector>
+#include <cstddef>
+#include <cstdint>
 typedef struct lua_State lua_State;
 
 std::vector<lua_State*> FindAllCoroutine(lua_State* L);
@@ -25,3 +28,173 @@ lua_State* GetMainState_lua52(lua_State* L);
 lua_State* GetMainState_lua51(lua_State* L);
 
 lua_State* GetMainState_luaJIT(lua_State* L);
+
+// 当前栈帧的标识, 同一深度上的帧标识相同, luajit 返回0
+intptr_t GetCurrentCallInfo(lua_State* L);
+
+intptr_t GetCurrentCallInfo_lua51(lua_State* L);
+
+intptr_t GetCurrentCallInfo_lua52(lua_State* L);
+
+intptr_t GetCurrentCallInfo_lua53(lua_State* L);
+
+intptr_t GetCurrentCallInfo_lua54(lua_State* L);
+
+// 从栈底到栈顶所有栈帧的标识
+std::vector<intptr_t> GetCallInfos(lua_State* L);
+
+std::vector<intptr_t> GetCallInfos_lua51(lua_State* L);
+
+std::vector<intptr_t> GetCallInfos_lua52(lua_State* L);
+
+std::vector<intptr_t> GetCallInfos_lua53(lua_State* L);
+
+std::vector<intptr_t> GetCallInfos_lua54(lua_State* L);
+
+// 把 lua_getinfo 得到的 lua 函数 source 所在的字符串对象压栈, 不复制内容
+// source 必须来自函数原型, 不能是 "=[C]"、"=?" 这类常量, luajit 不支持, 返回false
+bool PushSourceString(lua_State* L, const char* source);
+
+bool PushSourceString_lua51(lua_State* L, const char* source);
+
+bool PushSourceString_lua52(lua_State* L, const char* source);
+
+bool PushSourceString_lua53(lua_State* L, const char* source);
+
+bool PushSourceString_lua54(lua_State* L, const char* source);
+
+// lua 函数原型中的变量信息, 名字指向原型中的字符串, 原型存活期间有效
+struct FunctionDebugInfo
+{
+	struct LocVar
+	{
+		const char* name;
+		int startpc;
+		int endpc;
+	};
+
+	// 原型的地址, 用作缓存的键
+	const void* proto = nullptr;
+	// 指令数组的地址和定义行, 用于识别被回收后地址复用的原型
+	const void* code = nullptr;
+	int lineDefined = 0;
+	// 按声明顺序排列
+	std::vector<LocVar> locVars;
+	// 去掉调试信息时为空字符串
+	std::vector<const char*> upvalues;
+};
+
+// 读取栈顶lua 函数的原型信息, withVariables 为false 时不读取变量名
+// 栈顶不是lua 函数或者是luajit 时返回false
+bool GetFunctionDebugInfo(lua_State* L, FunctionDebugInfo& info, bool withVariables);
+
+bool GetFunctionDebugInfo_lua51(lua_State* L, FunctionDebugInfo& info, bool withVariables);
+
+bool GetFunctionDebugInfo_lua52(lua_State* L, FunctionDebugInfo& info, bool withVariables);
+
+bool GetFunctionDebugInfo_lua53(lua_State* L, FunctionDebugInfo& info, bool withVariables);
+
+bool GetFunctionDebugInfo_lua54(lua_State* L, FunctionDebugInfo& info, bool withVariables);
+
+// 表的内部布局
+struct TableShape
+{
+	// 数组部分和哈希部分的槽位数
+	size_t arraySize = 0;
+	size_t hashSize = 0;
+	// 值不为 nil 的槽位数, 槽位较多时为抽样估计
+	size_t arrayUsed = 0;
+	size_t hashUsed = 0;
+	bool estimated = false;
+};
+
+// 读取栈顶的表的布局, 最多检查固定数量的槽位, 不遍历表
+// 栈顶不是表或者是luajit 时返回false
+bool GetTableShape(lua_State* L, TableShape& shape);
+
+bool GetTableShape_lua51(lua_State* L, TableShape& shape);
+
+bool GetTableShape_lua52(lua_State* L, TableShape& shape);
+
+bool GetTableShape_lua53(lua_State* L, TableShape& shape);
+
+bool GetTableShape_lua54(lua_State* L, TableShape& shape);
+
+// 统计 size 个槽位中被使用的数量, 超过 samples 个时抽样估计
+template <class IsUsed>
+size_t CountTableSlots(size_t size, IsUsed isUsed, bool& estimated, size_t samples = 256)
+{
+	if (size <= samples)
+	{
+		size_t used = 0;
+		for (size_t i = 0; i < size; i++)
+		{
+			if (isUsed(i))
+			{
+				used++;
+			}
+		}
+		return used;
+	}
+
+	// 分段抽样, 段内位置打散, 避免与哈希部分按2的幂分布的槽位对齐
+	estimated = true;
+	size_t hits = 0;
+	for (size_t i = 0; i < samples; i++)
+	{
+		const size_t begin = i * size / samples;
+		const size_t end = (i + 1) * size / samples;
+		if (isUsed(begin + (i * 2654435761u) % (end - begin)))
+		{
+			hits++;
+		}
+	}
+	return hits * size / samples;
+}
+
+// 数组部分的抽样结果是连续的前缀时, 二分查找前缀的末尾, 否则与 CountTableSlots 相同
+template <class IsUsed>
+size_t CountArraySlots(size_t size, IsUsed isUsed, bool& estimated, size_t samples = 256)
+{
+	if (size <= samples)
+	{
+		return CountTableSlots(size, isUsed, estimated, samples);
+	}
+
+	// 第一个未使用的抽样点
+	size_t first = samples;
+	for (size_t i = 0; i < samples; i++)
+	{
+		const bool used = isUsed(i * size / samples);
+		if (first == samples && !used)
+		{
+			first = i;
+		}
+		else if (first != samples && used)
+		{
+			return CountTableSlots(size, isUsed, estimated, samples);
+		}
+	}
+
+	estimated = true;
+	if (first == 0)
+	{
+		return 0;
+	}
+	// lo 已使用, hi 未使用或越界
+	size_t lo = (first - 1) * size / samples;
+	size_t hi = first == samples ? size : first * size / samples;
+	while (hi - lo > 1)
+	{
+		const size_t mid = lo + (hi - lo) / 2;
+		if (isUsed(mid))
+		{
+			lo = mid;
+		}
+		else
+		{
+			hi = mid;
+		}
+	}
+	return lo + 1;
+}
@@ -1,67 +1,75 @@
 #pragma once
 
-#include <cinttypes>
-#include <vector>
-#include <exception>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
 #include <stdexcept>
+#include <string>
+#include <vector>
 
-template<class T>
-class Arena;
-
-
-
-template<class T>
-struct Idx {
-	using ArenaClass = Arena<T>;
+/*
+ * 分段数组, 每段 2^SegmentBits 个元素, 扩容时已有元素不移动
+ * Clear 只重置长度, 已分配的段留给下一次使用
+ */
+template<class T, unsigned SegmentBits = 7>
+class SegmentedArray {
+public:
+	static const uint32_t SegmentSize = 1u << SegmentBits;
 
-	Idx()
-		: Raw(0), _arena(nullptr) {
+	SegmentedArray()
+		: _size(0) {
 	}
 
-	Idx(uint32_t raw, ArenaClass *arena)
-		: Raw(raw),
-		  _arena(arena) {
+	// 追加一个元素, 返回它的下标, 复用的段中保留上一次的值
+	uint32_t Push() {
+		if (_size == _segments.size() * SegmentSize) {
+			_segments.emplace_back(new T[SegmentSize]());
+		}
+		return _size++;
 	}
 
-	T &operator*() {
-		return _arena->Index(*this);
+	T &operator[](uint32_t index) {
+		if (index < _size) {
+			return _segments[index >> SegmentBits][index & (SegmentSize - 1)];
+		}
+		throw std::runtime_error("index out of range");
 	}
 
-	T *operator->() {
-		return &(_arena->Index(*this));
+	uint32_t Size() const {
+		return _size;
 	}
 
-
-	ArenaClass *GetArena() {
-		return _arena;
+	void Clear() {
+		_size = 0;
 	}
 
-	uint32_t Raw;
-
 private:
-	ArenaClass *_arena;
+	std::vector<std::unique_ptr<T[]>> _segments;
+	uint32_t _size;
 };
 
-template<class T>
-class Arena {
+/*
+ * 字符串池, 在块内顺序分配以 '\0' 结尾的字符串, 返回的指针在 Clear 之前一直有效
+ * Clear 后保留普通块, 超过块大小的字符串单独分配并在 Clear 时释放
+ */
+class StringPool {
 public:
-	T &Index(Idx<T> id) {
-		if (id.Raw < _data.size()) {
-			return _data[id.Raw];
-		}
-		throw std::runtime_error("index out of range");
-	}
+	static const std::size_t BlockSize = 16 * 1024;
 
-	Idx<T> Alloc() {
-		uint32_t rawId = static_cast<uint32_t>(_data.size());
-		_data.emplace_back();
-		return Idx<T>(rawId, this);
-	}
+	StringPool();
 
-	void Clear() {
-		_data.clear();
+	const char *Store(const char *data, std::size_t size);
+
+	const char *Store(const std::string &str) {
+		return Store(str.data(), str.size());
 	}
 
+	void Clear();
+
 private:
-	std::vector<T> _data;
+	std::vector<std::unique_ptr<char[]>> _blocks;
+	std::vector<std::unique_ptr<char[]>> _largeBlocks;
+	// 当前使用的块和块内已用的字节数
+	std::size_t _block;
+	std::size_t _used;
 };
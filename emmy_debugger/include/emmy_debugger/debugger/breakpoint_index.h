@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include <unordered_set>
+#include <unordered_map>
+#include "emmy_debugger/proto/proto.h"
+
+/*
+ * 断点的只读快照
+ * 由消息线程在断点变化时整体重建并发布，hook 线程无锁读取，构建后不再修改
+ *
+ * 断点文件按 规范化后的路径 倒序插入后缀树
+ * chunkname 沿后缀树走一遍即可得到所有可能匹配的断点文件，按匹配度排序
+ */
+class BreakpointIndex {
+public:
+	using BreakpointList = std::vector<std::shared_ptr<BreakPoint>>;
+
+	BreakpointIndex(const BreakpointList &breakpoints, const std::vector<std::string> &extNames, uint64_t version);
+
+	bool Empty() const;
+
+	// 每次发布的索引版本都不同，可用来校验按索引缓存的结果
+	uint64_t GetVersion() const;
+
+	// 任意文件在该行上有断点
+	bool HasLine(int line) const;
+
+	// 返回可能对应该chunk的断点文件，匹配度高的在前
+	void MatchFiles(const std::string &chunkName, std::vector<int> &files) const;
+
+	// 按 MatchFiles 的顺序查找第一个在该行有断点的文件
+	std::shared_ptr<BreakPoint> FindBreakPoint(const std::vector<int> &files, int line) const;
+
+	// 这些文件在 [firstLine, lastLine] 之间是否有断点
+	bool HasBreakPointInRange(const std::vector<int> &files, int firstLine, int lastLine) const;
+
+private:
+	struct TrieNode {
+		std::vector<std::pair<char, int>> children;
+		// 以该节点结束的断点文件，没有则为 -1
+		int file = -1;
+	};
+
+	struct FileBreakpoints {
+		std::unordered_map<int, std::shared_ptr<BreakPoint>> lines;
+		// 有序的断点行号，用于按函数范围查找
+		std::vector<int> sortedLines;
+	};
+
+	// 统一大小写和分隔符，去掉 ./ 与重复的分隔符，trim 掉后缀
+	std::string NormalizePath(const std::string &path) const;
+
+	int FindChild(int node, char c) const;
+
+	void CollectFiles(int node, std::vector<int> &files) const;
+
+	uint64_t version;
+	std::vector<std::string> extNames;
+	std::unordered_set<int> lines;
+	std::vector<FileBreakpoints> files;
+	std::vector<TrieNode> nodes;
+};
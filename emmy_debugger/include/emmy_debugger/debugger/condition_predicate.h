@@ -0,0 +1,110 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "emmy_debugger/api/lua_api.h"
+#include "variable_path.h"
+
+/*
+ * 简单断点条件的本地求值
+ * 支持 name.field[1] 形式的路径与字面量(数字、不含转义的字符串、true/false/nil)之间的
+ * == ~= < <= > >= 比较, 比较之间可以用 and / or 连接, 整个条件也可以只是一个路径
+ *
+ * 求值时通过 VariablePath 读取值, 不编译也不调用lua 代码
+ * 可能触发元方法或会报错的情况返回 Unknown, 由调用者走lua 求值
+ * 5.3 以上的整数按整数精确比较, 整数与浮点数混合且整数超出 2^53 时同样返回 Unknown
+ */
+class ConditionPredicate {
+public:
+	enum class Result {
+		False,
+		True,
+		Unknown,
+	};
+
+	// 条件无法在本地求值时返回 nullptr
+	static std::shared_ptr<ConditionPredicate> Compile(const std::string &condition);
+
+	// 在 L 的第 level 层函数中求值, 不改变栈
+	Result Evaluate(lua_State *L, int level) const;
+
+private:
+	enum class CompareOp {
+		Eq,
+		Ne,
+		Lt,
+		Le,
+		Gt,
+		Ge,
+	};
+
+	struct Operand {
+		enum class Kind {
+			Path,
+			Nil,
+			Boolean,
+			Number,
+			String,
+		} kind = Kind::Nil;
+
+		VariablePath path;
+		bool boolean = false;
+		// 不带小数点和指数的字面量为整数
+		bool isInteger = false;
+		int64_t integer = 0;
+		lua_Number number = 0;
+		std::string str;
+	};
+
+	struct Node {
+		enum class Type {
+			Or,
+			And,
+			Compare,
+			// 整个条件只是一个路径, 值为 true 时成立
+			Truthy,
+		} type = Type::Compare;
+
+		int left = -1;
+		int right = -1;
+		CompareOp op = CompareOp::Eq;
+		Operand lhs;
+		Operand rhs;
+	};
+
+	// 求值过程中一个操作数的值, 字符串指向栈上的值
+	struct Value {
+		int type = LUA_TNIL;
+		bool boolean = false;
+		bool isInteger = false;
+		int64_t integer = 0;
+		lua_Number number = 0;
+		const char *str = nullptr;
+		size_t len = 0;
+		const void *pointer = nullptr;
+	};
+
+	class Parser;
+
+	struct Frame {
+		lua_State *L;
+		lua_Debug ar;
+	};
+
+	Result EvaluateNode(Frame &frame, int node) const;
+
+	// 把 operand 的值读到 value 中, 路径的值留在栈上
+	bool ReadOperand(Frame &frame, const Operand &operand, Value &value) const;
+
+	static Result Compare(const Value &lhs, const Value &rhs, CompareOp op);
+
+	static Result CompareNumber(const Value &lhs, const Value &rhs, CompareOp op);
+
+	template<typename T>
+	static Result CompareOrdered(T lhs, T rhs, CompareOp op);
+
+	std::vector<Node> nodes;
+	int root = -1;
+};
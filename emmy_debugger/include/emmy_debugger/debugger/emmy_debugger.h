@@ -23,11 +23,17 @@
 #include <memory>
 #include <set>
 #include <bitset>
+#include <atomic>
+#include <unordered_map>
 
 #include "emmy_debugger/api/lua_api.h"
+#include "emmy_debugger/api/lua_state.h"
 #include "hook_state.h"
 #include "emmy_debugger/proto/proto.h"
 #include "emmy_debugger/arena/arena.h"
+#include "breakpoint_index.h"
+#include "variable_cache.h"
+#include "mpsc_queue.h"
 
 using Executor = std::function<void(lua_State* L)>;
 class EmmyDebuggerManager;
@@ -35,6 +41,9 @@ class EmmyDebuggerManager;
 class Debugger: public std::enable_shared_from_this<Debugger>
 {
 public:
+	// 计数hook 的间隔指令数, 空闲时只靠它检查暂停请求和待执行的任务
+	static const int HookCount = 1000;
+
 	Debugger(lua_State* L, EmmyDebuggerManager* manager);
 	~Debugger();
 
@@ -69,19 +78,48 @@ public:
 	 */
 	void AsyncDoString(const std::string& code);
 	bool Eval(std::shared_ptr<EvalContext> evalContext, bool force = false);
-	bool GetStacks(std::vector<Stack>& stacks);
-	void GetVariable(lua_State* L, Idx<Variable> variable, int index, int depth, bool queryHelper = true);
+	bool BatchEval(std::shared_ptr<BatchEvalContext> batchContext, bool force = false);
+	// lazyStacks 为 true 时只有顶层栈帧带变量
+	bool GetStacks(std::vector<Stack>& stacks, bool lazyStacks = false);
+	bool StackVariables(std::shared_ptr<StackVariablesContext> stackContext);
+	bool ExpandVariable(std::shared_ptr<ExpandVariableContext> expandContext);
+	void GetVariable(lua_State* L, Variable variable, int index, int depth, bool queryHelper = true);
 	void DoAction(DebugAction action);
 	void EnterDebugMode();
 	void ExitDebugMode();
 	void ExecuteWithSkipHook(const Executor& exec);
+	/*
+	 * 可以在任意线程调用, 在下一次行事件或计数hook 中执行
+	 */
 	void ExecuteOnLuaThread(const Executor& exec);
+	/*
+	 * 在lua 线程上执行所有待执行的 executor, 返回执行的数量
+	 */
+	int Pump(lua_State* L);
 	void HandleBreak();
 	int GetStackLevel(bool skipC) const;
 	/*
 	 * 更新hook
 	 */
 	void UpdateHook(int mask, lua_State* L);
+	/*
+	 * 根据断点和当前状态计算协程 L 所需的最小hook mask, 总是包含 LUA_MASKCOUNT
+	 * 只有断点需要行事件时返回 call/ret, 行事件由 UpdateHookMask 按函数决定
+	 */
+	int GetHookMask(lua_State* L);
+	/*
+	 * L 的hook mask 与所需不一致时重新设置, ar 为空时按当前函数计算
+	 */
+	void UpdateHookMask(lua_State* L, lua_Debug* ar = nullptr);
+	/*
+	 * 状态或断点变化后其他协程所需的mask 也变化时, 重新设置所有协程的hook
+	 * 否则只有计数hook 的协程要等到下一次计数事件才会更新
+	 */
+	void UpdateCoroutineHooks(lua_State* L);
+	/*
+	 * 状态机需要的hook 事件变化时调用, 使缓存的hook mask 失效
+	 */
+	void InvalidateHookMask();
 
 	/*
 	 * 设置当前状态机，他的锁由doAction负责
@@ -89,31 +127,114 @@ public:
 	void SetHookState(std::shared_ptr<HookState> newState);
 	EmmyDebuggerManager* GetEmmyDebuggerManager();
 
-	void SetVariableArena(Arena<Variable> *arena);
+	void SetVariableArena(VariableArena *arena);
 
-	Arena<Variable> *GetVariableArena();
+	VariableArena *GetVariableArena();
 
 	void ClearVariableArenaRef();
 
 	bool RegisterTypeName(const std::string& typeName, std::string& err);
 
 private:
+	// chunk 路径解析缓存, 以 lua_Debug::source 指针为键
+	// source 字符串在chunk存活期间地址不变, 字符串 chunk 的 source 被引用住, 其他的命中时再比较内容以防回收后地址被复用
+	struct ChunkFile
+	{
+		// 没有引用住时保存 source 用于比较
+		std::string source;
+		bool pinned = false;
+		std::string file;
+		// 按断点索引版本缓存的匹配文件
+		uint64_t breakpointVersion = 0;
+		std::vector<int> breakpointFiles;
+	};
+
 	std::shared_ptr<BreakPoint> FindBreakPoint(lua_Debug* ar);
-	std::shared_ptr<BreakPoint> FindBreakPoint(const std::string& file, int line);
 	std::string GetFile(lua_Debug* ar) const;
+	ChunkFile& GetChunkFile(lua_Debug* ar) const;
+	// 缓存的 chunk 是否就是 source, 字符串 chunk 的开销与 source 的长度无关
+	static bool IsSameSource(const ChunkFile& chunk, const char* source);
+	// 在注册表中引用 source 字符串, 直到路径缓存清空
+	static bool PinChunkSource(lua_State* L, const char* source);
+	void ClearChunkFileCache(lua_State* L) const;
+	// 断点有变化时重新匹配chunk 对应的断点文件
+	void MatchBreakpointFiles(ChunkFile& chunk, const BreakpointIndex* index) const;
+	// 栈上level 层的函数是否可能命中断点, 无法判断时返回true
+	bool ActivationHasBreakPoint(lua_State* L, int level);
+	// emmy.fixPath 变化时清空路径缓存, 只在计数hook、中断和附加时检查
+	void CheckFixPath(lua_State* L) const;
+	// emmy.fixPath 的当前值，用于判断路径缓存是否失效
+	const void* GetFixPathIdentity(lua_State* L) const;
+
+	// 求值环境按名字查找局部变量和上值用的函数布局, 每个函数原型只建立一次
+	struct FrameLayout
+	{
+		// 用于识别被回收后地址复用的原型
+		const void* code = nullptr;
+		int lineDefined = 0;
+		// 局部变量名 -> 可能的 lua_getlocal 序号, 从大到小, 同名时序号大的在内层
+		std::unordered_map<std::string, std::vector<int>> locals;
+		// 上值名 -> 最后一个同名上值的序号
+		std::unordered_map<std::string, int> upvalues;
+	};
+
+	// 正在求值的栈帧
+	struct EvalFrame
+	{
+		lua_State* L;
+		lua_Debug ar;
+		const FrameLayout* layout;
+	};
+
+	// 一次求值中共享的环境, 第一次需要时才创建
+	struct EvalEnv
+	{
+		EvalFrame frame;
+		// 环境在栈上的位置, 0 表示还未创建
+		int index = 0;
+		bool lazy = false;
+	};
+
+	// 一个需要在lua 线程处理的请求, 只有一个成员不为空
+	struct EvalRequest
+	{
+		std::shared_ptr<EvalContext> eval;
+		std::shared_ptr<BatchEvalContext> batch;
+		std::shared_ptr<StackVariablesContext> stack;
+		std::shared_ptr<ExpandVariableContext> expand;
+	};
 
 	void CheckDoString();
+	// 把 stackLevel 层函数的所有局部变量和上值复制到新建的环境中, 用于无法按原型查找的函数
 	bool CreateEnv(lua_State* L, int stackLevel);
+	// 压入共享的惰性求值环境, 名字在访问时才到 frame 中查找, 无法取得函数布局时返回false
+	bool PushLazyEnv(lua_State* L, int stackLevel, EvalFrame& frame);
+	const FrameLayout* GetFrameLayout(lua_State* L, lua_Debug* ar);
+	static int EvalEnvIndex(lua_State* L);
+	static int EvalEnvNewIndex(lua_State* L);
+	// 找到时压入该值, 同名时取内层的局部变量
+	static bool PushFrameLocal(lua_State* L, EvalFrame* frame, const char* name, int& n);
+	static bool PushFrameUpvalue(lua_State* L, EvalFrame* frame, const char* name, int& n);
 	bool ProcessBreakPoint(std::shared_ptr<BreakPoint> bp);
+	// 把编译后的 statement 压栈, 同一语句只编译一次, 之后每次只重新绑定环境
+	bool LoadEvalChunk(lua_State* L, const std::string& statement);
 	bool DoEval(std::shared_ptr<EvalContext> evalContext);
+	// 求值 expr, 不使用 evalContext.expr, 结果和错误写入 evalContext
+	bool DoEval(EvalContext& evalContext, const std::string& expr);
+	void DoBatchEval(std::shared_ptr<BatchEvalContext> batchContext);
+	void DoStackVariables(std::shared_ptr<StackVariablesContext> stackContext);
+	// 读取 ar 对应栈帧的局部变量和上值
+	void GetStackVariables(lua_State* L, lua_Debug* ar, Stack& stack);
+	// 读取下一块子节点, 受 expandChunkSize 和 expandTimeBudget 限制
+	void DoExpandVariable(std::shared_ptr<ExpandVariableContext> expandContext);
+	// 找到 stackLevel 所在的协程, stackLevel 改为协程内的层数
+	lua_State* GetEvalState(int& stackLevel);
+	bool PushEvalEnv(lua_State* L, int stackLevel, EvalEnv& env);
+	bool DoEval(lua_State* L, int stackLevel, EvalContext& evalContext, const std::string& expr, EvalEnv& env);
 	void DoLogMessage(std::shared_ptr<BreakPoint> bp);
-	bool DoHitCondition(std::shared_ptr<BreakPoint> bp);
-	// 模糊匹配算法会算出匹配度
-	// 当多个文件路径都有可能命中应该采用匹配度最高的路径
-	int FuzzyMatchFileName(const std::string& chunkName, const std::string& fileName) const;
-	void CacheValue(int valueIndex, Idx<Variable> variable) const;
+	void CacheValue(lua_State* L, int valueIndex, Variable variable);
 	// bool HasCacheValue(int valueIndex) const;
-	void ClearCache() const;
+	void ClearCache();
 
 	int GetTypeFromName(const char* typeName);
 
@@ -125,6 +246,8 @@ private:
 	// 取消递归锁的使用
 	std::mutex hookStateMtx;
 	std::shared_ptr<HookState> hookState;
+	// hook 线程读取的当前状态机, 状态机由 manager 持有, 不加锁也不增加引用计数
+	std::atomic<HookState*> activeHookState;
 
 	bool running;
 	bool skipHook;
@@ -135,14 +258,61 @@ private:
 	std::mutex runMtx;
 	std::condition_variable cvRun;
 
-	std::mutex luaThreadMtx;
-	std::vector<Executor> luaThreadExecutors;
+	// 执行 luaThreadExecutors, 只能在lua 线程调用
+	int ProcessLuaThreadExecutors();
+
+	// 元素带有入队时的 luaThreadExecutorsEpoch, Stop 之后旧的 executor 不再执行
+	MpscQueue<std::pair<uint64_t, Executor>> luaThreadExecutors;
+	std::atomic<uint64_t> luaThreadExecutorsEpoch;
+	// 有待执行的 executor, hook 中只检查这个标记
+	std::atomic<bool> luaThreadExecutorsPending;
 
 	std::mutex evalMtx;
-	std::queue<std::shared_ptr<EvalContext>> evalQueue;
+	std::queue<EvalRequest> evalQueue;
 
-	Arena<Variable> *arenaRef;
+	VariableArena *arenaRef;
+	// 中断时的栈帧变量和 StackVariablesReq 使用, 每次读取前清空, 内存在多次中断间复用
+	std::shared_ptr<VariableArena> stackArena;
+	// 条件断点和日志断点的求值结果, 只在 hook 中使用
+	std::shared_ptr<VariableArena> scratchArena;
+	// 条件断点和日志断点共用的求值上下文, 每次求值前 Reset
+	EvalContext scratchEvalContext;
+	// 发给 IDE 的 cacheId 对应的值, 退出调试模式时清空
+	VariableCache variableCache;
 
 	bool displayCustomTypeInfo;
 	std::bitset<LUA_NUMTAGS> registeredTypes;
+
+	// hook 状态每次变化都会增加, 用于判断缓存的hook mask 是否过期
+	std::atomic<uint64_t> hookStateVersion;
+	uint64_t hookMaskStateVersion;
+	uint64_t hookMaskBreakpointVersion;
+	int hookMask;
+	// hookMask 是为哪个协程计算的, 状态机可能只对单步的协程裁剪事件
+	lua_State* hookMaskL;
+	// 状态或断点版本变化后还没有检查其他协程
+	bool hookMaskChanged;
+	// 所有协程的hook 都至少包含的mask
+	int coroutineHookMask;
+	// 状态机自身需要的hook 事件
+	int hookStateMask;
+	// 行事件只在有断点的函数中打开
+	bool hookLineGated;
+
+	mutable std::unordered_map<const char*, ChunkFile> chunkFileCache;
+	mutable const void* chunkFileFixPath;
+	// fixPath 出错时结果不进缓存, 暂存在这里
+	mutable ChunkFile uncachedChunkFile;
+	// 求值chunk 缓存中的条目数
+	int evalChunkCount;
+	// 日志断点拼接消息用的缓冲区, 只在lua 线程使用
+	std::string logBuffer;
+	// 按函数原型缓存的布局, 只在lua 线程使用
+	std::unordered_map<const void*, FrameLayout> frameLayoutCache;
+	FunctionDebugInfo functionDebugInfo;
+
+	// 当前线程上正在求值的栈帧, 惰性环境通过它查找变量
+	static thread_local EvalFrame* currentEvalFrame;
+	// 惰性环境中写入过不属于栈帧的名字, 下次求值前需要换一个干净的环境
+	static thread_local bool evalEnvDirty;
 };
@@ -8,6 +8,7 @@
 #include <atomic>
 #include "hook_state.h"
 #include "emmy_debugger.h"
+#include "breakpoint_index.h"
 #include "emmy_debugger/api/lua_api.h"
 
 
@@ -24,6 +25,33 @@ public:
 	 */
 	std::shared_ptr<Debugger> GetDebugger(lua_State* L);
 
+	/*
+	 * 每个 hook 线程进入 HookScope 时看到的版本, 不在 hook 中时为 UINT64_MAX
+	 */
+	struct HookReader
+	{
+		std::atomic<uint64_t> debuggersEpoch{UINT64_MAX};
+		std::atomic<uint64_t> breakpointEpoch{UINT64_MAX};
+	};
+
+	/*
+	 * hook 线程持有期间, 被移除的 debugger 只退役不释放, 被替换的断点索引也不释放
+	 * 每个线程记录进入时看到的 debuggersVersion 和断点索引版本, 嵌套时只有最外层生效
+	 * 所有读取 debugger 或断点索引的 lua 线程入口都需要持有
+	 */
+	class HookScope
+	{
+	public:
+		explicit HookScope(EmmyDebuggerManager& manager);
+		~HookScope();
+	};
+
+	/*
+	 * hook 线程使用，按线程缓存最近一次查找的 L, 命中时不加锁也不增加引用计数
+	 * 必须在 HookScope 内调用, 返回的指针在 HookScope 结束之前有效
+	 */
+	Debugger* GetHookDebugger(lua_State* L);
+
 	/*
 	 * 如果L 是main thread 则添加一个新的debugger 否则返回他所在的main thread对应的debugger
 	 */
@@ -57,9 +85,14 @@ public:
 
     void RemoveAllBreakpoints();
 
-    void RefreshLineSet();
-	// 返回拷贝后的断点行集
-	std::set<int> GetLineSet();
+	// 设置lua文件后缀, 断点索引匹配路径时会 trim 掉这些后缀
+	void SetExtNames(const std::vector<std::string>& exts);
+
+	/*
+	 * hook 线程获取当前断点索引，不加锁也不拷贝
+	 * 必须在 HookScope 内调用, 返回的指针在 HookScope 结束之前有效
+	 */
+	const BreakpointIndex* AcquireBreakpointIndex();
 
 	void HandleBreak(lua_State* L);
 
@@ -69,6 +102,21 @@ public:
 	// 计算表达式
 	void Eval(std::shared_ptr<EvalContext> ctx);
 
+	// 一次计算同一栈帧的多个表达式
+	void BatchEval(std::shared_ptr<BatchEvalContext> ctx);
+
+	// 读取一个栈帧的变量
+	void StackVariables(std::shared_ptr<StackVariablesContext> ctx);
+
+	// 分页展开一个表
+	void ExpandVariable(std::shared_ptr<ExpandVariableContext> ctx);
+
+	// 替换监视表达式, 为空时中断不再计算
+	void SetWatches(const std::vector<std::string>& exprs, int depth);
+
+	// 为当前的监视表达式创建一次求值, 没有监视表达式时返回 nullptr
+	std::shared_ptr<BatchEvalContext> CreateWatchContext();
+
 	void OnDisconnect();
 
 	void SetRunning(bool value);
@@ -86,24 +134,59 @@ public:
 	// 但实际上通常不会改变
 	// 暂时不加
 	std::string helperCode;
-	std::vector<std::string> extNames;
+
+	// 求值的指令数和内存上限, 由 InitReq 设置
+	std::atomic<int64_t> evalInstructionLimit;
+	std::atomic<int64_t> evalMemoryLimit;
+	// 中断时只收集顶层栈帧的变量
+	std::atomic<bool> lazyStacks;
+	// 分页展开表的参数, 见 InitParams
+	std::atomic<int> expandChunkSize;
+	std::atomic<int> expandTimeBudget;
+	std::atomic<int> tableChildrenLimit;
+	// 缓存表的值为弱引用
+	std::atomic<bool> weakCache;
 
 	ExtensionPoint extension;
 private:
 	UniqueIdentifyType GetUniqueIdentify(lua_State* L);
 
+	// 调用者需持有 breakpointsMtx
+	void PublishBreakpointIndex();
+
+	void ReclaimBreakpointIndexes();
+
+	// 调用者需持有 debuggerMtx, 可以释放的 debugger 移入 reclaimed, 在锁外析构
+	void ReclaimDebuggers(std::vector<std::shared_ptr<Debugger>>& reclaimed);
+
 	// 需要一个锁，真的需要这个锁吗？
 	std::mutex debuggerMtx;
 	// key 是唯一标记（对普通lua就是main state指针，对luajit就是注册表指针）,value 是debugger
 	std::map<UniqueIdentifyType , std::shared_ptr<Debugger>> debuggers;
+	// debuggers 每次增删都会增加，用于判断 hook 线程的缓存是否过期
+	std::atomic<uint64_t> debuggersVersion;
+	// 所有 hook 线程的记录, 回收 debugger 和断点索引时取其中的最小版本
+	std::vector<std::shared_ptr<HookReader>> hookReaders;
+	// 已被移除但可能仍有 hook 线程在用的 debugger, 与移除后的 debuggersVersion
+	std::vector<std::pair<uint64_t, std::shared_ptr<Debugger>>> retiredDebuggers;
 
 	std::mutex breakDebuggerMtx;
 	std::shared_ptr<Debugger> hitDebugger;
 
 	std::mutex breakpointsMtx;
 	std::vector<std::shared_ptr<BreakPoint>> breakpoints;
+	std::vector<std::string> extNames;
+
+	std::mutex watchesMtx;
+	std::vector<std::string> watches;
+	int watchDepth;
 
-	std::set<int> lineSet;
+	// 当前发布的断点索引，所有权在 currentBreakpointIndex
+	std::atomic<const BreakpointIndex*> breakpointIndex;
+	std::atomic<uint64_t> breakpointIndexEpoch;
+	std::shared_ptr<const BreakpointIndex> currentBreakpointIndex;
+	// 已被替换但可能仍有 hook 线程在读的索引
+	std::vector<std::pair<uint64_t, std::shared_ptr<const BreakpointIndex>>> retiredBreakpointIndexes;
 
 	std::atomic<bool> isRunning;
 };
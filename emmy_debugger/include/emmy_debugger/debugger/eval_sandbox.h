@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include "emmy_debugger/api/lua_api.h"
+
+/*
+ * 在独立的协程中执行求值chunk, 限制指令数和内存
+ * 协程挂在注册表中, 正常返回后留给下一次求值, 出错后丢弃
+ * 中断时处于hook 中, 当前协程的hook 不会再触发, 所以指令数只能用求值协程上的计数hook 限制
+ * 内存通过临时替换 lua_Alloc 限制, 替换期间整个 lua 状态机的分配都会计入
+ */
+class EvalSandbox {
+public:
+	// 限制为0 时不检查
+	EvalSandbox(int64_t instructionLimit, int64_t memoryLimit);
+
+	/*
+	 * 调用栈顶的函数, 不带参数
+	 * 成功时第一个返回值替换函数并返回true, 失败时弹出函数, 错误信息写入 error
+	 */
+	bool Call(lua_State *L, std::string &error);
+
+private:
+	struct AllocState {
+		lua_Alloc alloc;
+		void *ud;
+		int64_t used;
+		int64_t limit;
+		bool exceeded;
+	};
+
+	// 压入求值协程并返回
+	static lua_State *AcquireThread(lua_State *L);
+
+	static void *LimitedAlloc(void *ud, void *ptr, size_t osize, size_t nsize);
+
+	static void InstructionLimitHook(lua_State *L, lua_Debug *ar);
+
+	static int Resume(lua_State *thread, lua_State *from);
+
+	int64_t instructionLimit;
+	int64_t memoryLimit;
+};
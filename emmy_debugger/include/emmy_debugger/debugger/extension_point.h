@@ -12,11 +12,11 @@ public:
 
 	void Initialize(lua_State *L);
 	// 
-	bool QueryVariable(lua_State *L, Idx<Variable> variable, const char *typeName, int object, int depth);
-	bool QueryVariableCustom(lua_State *L, Idx<Variable> variable, const char *typeName, int object, int depth);
+	bool QueryVariable(lua_State *L, Variable variable, const char *typeName, int object, int depth);
+	bool QueryVariableCustom(lua_State *L, Variable variable, const char *typeName, int object, int depth);
 
 	lua_State *QueryParentThread(lua_State *L);
 
 private:
-	bool QueryVariableGeneric(lua_State *L, Idx<Variable> variable, const char *typeName, int object, int depth, const char* queryFunction);
+	bool QueryVariableGeneric(lua_State *L, Variable variable, const char *typeName, int object, int depth, const char* queryFunction);
 };
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+/*
+ * 预先解析的命中条件
+ * 支持 == N, > N, >= N, < N, <= N 和 % N, 运算符与数字之间可以有空格
+ * 无法解析的条件永远不成立
+ */
+class HitCondition {
+public:
+	explicit HitCondition(const std::string &hitCondition);
+
+	// hitCount 为包括本次在内的命中次数
+	bool Check(uint64_t hitCount) const;
+
+private:
+	enum class Operator {
+		// 解析失败
+		Never,
+		Eq,
+		Gt,
+		GtEq,
+		Lt,
+		LtEq,
+		// 每 N 次命中一次
+		Mod,
+	};
+
+	Operator op;
+	uint64_t hitTimes;
+};
@@ -17,6 +17,8 @@
 
 #include <string>
 #include <memory>
+#include <vector>
+#include <atomic>
 #include "emmy_debugger/api/lua_api.h"
 
 class Debugger;
@@ -31,20 +33,33 @@ public:
 	}
 
 	virtual bool Start(std::shared_ptr<Debugger> debugger, lua_State* current);
-	virtual void ProcessHook(std::shared_ptr<Debugger> debugger, lua_State* L, lua_Debug* ar);
+	// 在hook 中调用, debugger 以裸指针传入避免引用计数
+	virtual void ProcessHook(Debugger* debugger, lua_State* L, lua_Debug* ar);
+	// 该状态在协程 L 中需要的hook事件, 默认需要行事件
+	virtual int GetHookMask(lua_State* L);
 };
 
 // continue
 class HookStateContinue : public HookState {
 	bool Start(std::shared_ptr<Debugger> debugger, lua_State* current) override;
+	int GetHookMask(lua_State* L) override;
 };
 
 class StackLevelBasedState : public HookState {
 protected:
 	int oriStackLevel;
 	int newStackLevel;
+	// 当前栈上每一帧的标识, 由 call/return 事件增量维护
+	std::vector<intptr_t> callInfos;
+	// 无法得到帧标识时(luajit)用于定期校验深度
+	int validateCountdown = 0;
 	bool Start(std::shared_ptr<Debugger> debugger, lua_State* current) override;
-	void UpdateStackLevel(std::shared_ptr<Debugger> debugger, lua_State* L, lua_Debug* ar);
+	int GetHookMask(lua_State* L) override;
+	void UpdateStackLevel(Debugger* debugger, lua_State* L, lua_Debug* ar);
+	// 遍历整个栈重建 callInfos
+	void ResetStackLevel(lua_State* L);
+	// 弹出已经不在栈上的帧直到栈顶为 callInfo, 找不到时返回false
+	bool PopToCallInfo(intptr_t callInfo);
 };
 
 // step in
@@ -52,30 +67,39 @@ class HookStateStepIn : public StackLevelBasedState {
 	std::string file;
 	int line = 0;
 	bool Start(std::shared_ptr<Debugger> debugger, lua_State* current) override;
-	void ProcessHook(std::shared_ptr<Debugger> debugger, lua_State* L, lua_Debug* ar) override;
+	void ProcessHook(Debugger* debugger, lua_State* L, lua_Debug* ar) override;
+	// 单步进入只关心行是否变化, 不需要栈深度
+	int GetHookMask(lua_State* L) override;
 };
 
 // step out
 class HookStateStepOut : public StackLevelBasedState {
 	bool Start(std::shared_ptr<Debugger> debugger, lua_State* current) override;
-	void ProcessHook(std::shared_ptr<Debugger> debugger, lua_State* L, lua_Debug* ar) override;
+	void ProcessHook(Debugger* debugger, lua_State* L, lua_Debug* ar) override;
 };
 
 // step over
 class HookStateStepOver : public StackLevelBasedState {
 	std::string file;
 	int line = 0;
+	// currentStateL 的栈比开始时深, 此时只保留 call/return 事件, 行事件只在有断点的函数中打开
+	std::atomic<bool> inCallee{false};
+	// 被调用的是 coroutine.yield, 此时其他协程保留行事件
+	std::atomic<bool> calleeYields{false};
+	const void* yieldFunction = nullptr;
 
 	bool Start(std::shared_ptr<Debugger> debugger, lua_State* current) override;
-	void ProcessHook(std::shared_ptr<Debugger> debugger, lua_State* L, lua_Debug* ar) override;
+	void ProcessHook(Debugger* debugger, lua_State* L, lua_Debug* ar) override;
+	int GetHookMask(lua_State* L) override;
 };
 
 // always break
 class HookStateBreak : public HookState {
-	void ProcessHook(std::shared_ptr<Debugger> debugger, lua_State* L, lua_Debug* ar) override;
+	void ProcessHook(Debugger* debugger, lua_State* L, lua_Debug* ar) override;
 };
 
 // stop
 class HookStateStop : public HookState {
 	bool Start(std::shared_ptr<Debugger> debugger, lua_State* current) override;
+	int GetHookMask(lua_State* L) override;
 };
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+/*
+ * 预先解析的日志断点模板
+ * 添加断点时把 logMessage 拆成字面量和 {expr} 表达式, 命中时只需依次拼接
+ * {{ 和 }} 转义为 { 和 }
+ */
+class LogTemplate {
+public:
+	struct Segment {
+		std::string text;
+		// text 是需要求值的表达式
+		bool isExpr = false;
+	};
+
+	LogTemplate(const std::string &file, int line, const std::string &logMessage);
+
+	// [文件名:行号] 前缀
+	const std::string &GetPrefix() const;
+
+	const std::vector<Segment> &GetSegments() const;
+
+	// 前缀和字面量的总长度, 用于预留缓冲区
+	std::size_t GetLiteralSize() const;
+
+private:
+	void AppendLiteral(const std::string &logMessage, std::size_t start, std::size_t end);
+
+	std::string prefix;
+	std::vector<Segment> segments;
+	std::size_t literalSize;
+};
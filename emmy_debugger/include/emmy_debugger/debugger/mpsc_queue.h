@@ -0,0 +1,103 @@
+﻿/*
+* Copyright (c) 2019. tangzx(love.tangzx@qq.com)
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+#pragma once
+
+#include <atomic>
+#include <utility>
+
+/*
+ * 多生产者单消费者的无锁队列
+ * Push 可以在任意线程调用, Pop 只能在同一时刻由一个线程调用
+ * 生产者 Push 到一半时 Pop 可能暂时返回false, 该元素在下一次 Pop 时取出
+ */
+template<class T>
+class MpscQueue {
+public:
+	MpscQueue()
+		: head(&stub), tail(&stub) {
+		stub.next.store(nullptr, std::memory_order_relaxed);
+	}
+
+	~MpscQueue() {
+		T value;
+		while (Pop(value)) {
+		}
+	}
+
+	MpscQueue(const MpscQueue&) = delete;
+	MpscQueue& operator=(const MpscQueue&) = delete;
+
+	void Push(T value) {
+		Push(new Node(std::move(value)));
+	}
+
+	bool Pop(T& value) {
+		Node* current = tail;
+		Node* next = current->next.load(std::memory_order_acquire);
+		// 跳过占位节点
+		if (current == &stub) {
+			if (next == nullptr) {
+				return false;
+			}
+			tail = next;
+			current = next;
+			next = next->next.load(std::memory_order_acquire);
+		}
+
+		if (next == nullptr) {
+			// current 是最后一个节点时先把占位节点放回队尾, 保证 current 可以释放
+			if (current != head.load(std::memory_order_acquire)) {
+				return false;
+			}
+			Push(&stub);
+			next = current->next.load(std::memory_order_acquire);
+			if (next == nullptr) {
+				return false;
+			}
+		}
+
+		tail = next;
+		value = std::move(current->value);
+		delete current;
+		return true;
+	}
+
+private:
+	struct Node {
+		Node()
+			: next(nullptr) {
+		}
+
+		explicit Node(T&& value)
+			: value(std::move(value)), next(nullptr) {
+		}
+
+		T value;
+		std::atomic<Node*> next;
+	};
+
+	void Push(Node* node) {
+		node->next.store(nullptr, std::memory_order_relaxed);
+		Node* prev = head.exchange(node, std::memory_order_acq_rel);
+		prev->next.store(node, std::memory_order_release);
+	}
+
+	Node stub;
+	// 生产者端
+	std::atomic<Node*> head;
+	// 消费者端, 只由消费者访问
+	Node* tail;
+};
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * 在定长缓冲区中拼接变量的名字和值, 结果再存入 arena 的字符串池
+ * 不使用 iostream, 不分配内存, 整数和指针不受 locale 影响, 超出缓冲区的部分被截断
+ */
+class ValueFormatter {
+public:
+	static const std::size_t Capacity = 128;
+
+	ValueFormatter();
+
+	ValueFormatter &Append(const char *str);
+
+	ValueFormatter &Append(const char *str, std::size_t size);
+
+	ValueFormatter &AppendInteger(int64_t value);
+
+	ValueFormatter &AppendUnsigned(uint64_t value);
+
+	// 整数值按整数输出, 其他与lua 相同按 %.14g 输出
+	ValueFormatter &AppendNumber(double value);
+
+	// 0x 加小写十六进制
+	ValueFormatter &AppendPointer(const void *pointer);
+
+	const char *Data() const {
+		return _buffer;
+	}
+
+	std::size_t Size() const {
+		return _size;
+	}
+
+private:
+	char _buffer[Capacity];
+	std::size_t _size;
+};
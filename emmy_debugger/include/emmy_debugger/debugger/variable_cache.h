@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "emmy_debugger/api/lua_api.h"
+
+/*
+ * 中断期间发给 IDE 的值的缓存, 用 cacheId 找回原来的值
+ * 值保存在注册表中缓存表的数组部分, cacheId 由中断的代数, 槽位的代数和槽位组成, 共 53 位, 在 js 中不丢精度
+ * 每次中断结束时整体丢弃并换一个中断代数, 释放的槽位进入空闲链表, 再次分配时换一个槽位代数
+ * 槽位代数用完的槽位不再重用, 所以同一次中断内旧的 cacheId 不会找到其他值, 中断代数约 3300 万次后才回绕
+ * weak 模式下缓存表的值为弱引用, 长时间暂停时不阻止回收, 被回收的值查找失败
+ * 只在 lua 线程中使用
+ */
+class VariableCache {
+public:
+	VariableCache();
+
+	// 缓存 valueIndex 处的值, 返回 cacheId, 槽位用完时返回 0
+	int64_t Store(lua_State *L, int valueIndex, bool weak);
+
+	// 用 valueIndex 处的值替换 cacheId 对应的值, cacheId 无效时返回 false
+	bool Replace(lua_State *L, int64_t cacheId, int valueIndex);
+
+	// 把 cacheId 对应的值压栈, cacheId 无效或值已被回收时返回 false, 栈不变
+	bool Push(lua_State *L, int64_t cacheId);
+
+	// 释放 cacheId 的槽位, 之后该 cacheId 无效
+	void Release(lua_State *L, int64_t cacheId);
+
+	// 丢弃所有缓存的值, 之前的 cacheId 全部无效
+	void Clear(lua_State *L);
+
+private:
+	static const int SlotBits = 20;
+	static const int GenerationBits = 8;
+	static const int EpochBits = 25;
+	static const uint32_t SlotMask = (1u << SlotBits) - 1;
+	static const uint32_t GenerationMask = (1u << GenerationBits) - 1;
+	static const uint32_t EpochMask = (1u << EpochBits) - 1;
+
+	struct Slot {
+		uint8_t generation;
+		bool used;
+	};
+
+	// cacheId 有效时返回槽位, 否则返回 0
+	uint32_t Find(int64_t cacheId) const;
+
+	// 压入缓存表, 不存在且 create 为 false 时返回 false
+	bool PushTable(lua_State *L, bool create, bool weak);
+
+	// 下标 0 不使用
+	std::vector<Slot> _slots;
+	std::vector<uint32_t> _freeSlots;
+	// 本次中断的代数, 从 1 开始
+	uint32_t _epoch;
+	// 上一次中断用到的槽位数, 新缓存表按此预留数组部分
+	int _lastSize;
+};
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "emmy_debugger/api/lua_api.h"
+
+/*
+ * name.field[1]["key"] 形式的变量路径
+ * 按求值环境的顺序(上值, 局部变量, _ENV, 全局)查找变量, 字段用 raw 访问读取
+ * 不编译chunk, 不创建环境, 也不调用lua 代码
+ */
+class VariablePath {
+public:
+	struct Key {
+		std::string name;
+		// name 为空时表示整数下标
+		int index = 0;
+	};
+
+	// 整个 text 是一个路径时返回true
+	static bool Parse(const std::string &text, VariablePath &path);
+
+	// 从 pos 开始解析一个路径, 成功时 pos 移到路径之后, 供其他解析器复用
+	static bool Parse(const std::string &text, std::size_t &pos, VariablePath &path);
+
+	static bool IsKeyword(const std::string &name);
+
+	/*
+	 * 在 ar 对应的函数中读取路径的值并压栈
+	 * 可能触发元方法或会报错时返回false, 栈不变, 由调用者交给lua 求值
+	 */
+	bool Push(lua_State *L, lua_Debug *ar) const;
+
+private:
+	// 找到变量时压栈, 值为 nil 时同样压栈并返回true
+	static bool PushVariable(lua_State *L, lua_Debug *ar, const std::string &name);
+
+	std::vector<Key> keys;
+};
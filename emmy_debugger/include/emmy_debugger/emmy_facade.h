@@ -59,6 +59,7 @@ public:
 	bool PipeConnect(lua_State* L, const std::string& name, std::string& err);
 	int BreakHere(lua_State* L);
 	bool RegisterTypeName(lua_State *L, const std::string &typeName, std::string &err);
+	int Pump(lua_State* L);
 	
 	int OnConnect(bool suc);
 	int OnDisconnect();
@@ -66,7 +67,12 @@ public:
 	bool OnBreak(std::shared_ptr<Debugger> debugger);
 	void Destroy();
 	void OnEvalResult(std::shared_ptr<EvalContext> context);
+	void OnBatchEvalResult(std::shared_ptr<BatchEvalContext> context);
+	void OnStackVariablesResult(std::shared_ptr<StackVariablesContext> context);
+	void OnExpandVariableResult(std::shared_ptr<ExpandVariableContext> context);
 	void SendLog(LogType type, const char* fmt, ...);
+	// 不经过格式化, 没有长度限制
+	void SendLog(LogType type, const std::string& message);
 	void OnLuaStateGC(lua_State* L);
 	void Hook(lua_State* L, lua_Debug* ar);
 	EmmyDebuggerManager& GetDebugManager();
@@ -88,6 +94,9 @@ public:
 
 	void ReadyReq();
 
+	// 在消息线程回复所有断点的命中次数
+	void HitCountReq();
+
 	void OnReceiveMessage(nlohmann::json document);
 
 	// Start hook 作为成员存在
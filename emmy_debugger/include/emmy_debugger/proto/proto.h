@@ -17,9 +17,15 @@
 
 #include "emmy_debugger/arena/arena.h"
 #include "nlohmann/json.hpp"
+#include <atomic>
+#include <cstdint>
+#include <memory>
 #include <string>
 #include <vector>
 
+class ConditionPredicate;
+class LogTemplate;
+class HitCondition;
 
 enum class DebugAction {
 	None = -1,
@@ -54,6 +60,18 @@ class InitParams : public JsonProtocol {
 public:
 	std::string emmyHelper;
 	std::vector<std::string> ext;
+	// 每次求值的指令数和内存上限, 0 表示不限制
+	int64_t evalInstructionLimit = 50000000;
+	int64_t evalMemoryLimit = 64 * 1024 * 1024;
+	// BreakNotify 只带顶层栈帧的变量, 其他栈帧用 StackVariablesReq 读取
+	bool lazyStacks = false;
+	// ExpandVariableReq 每个响应最多的子节点数, 以及每次占用lua 线程的毫秒数
+	int expandChunkSize = 1000;
+	int expandTimeBudget = 10;
+	// 展开表时最多创建的子节点数, 其余的用 ExpandVariableReq 读取, 0 表示不限制
+	int tableChildrenLimit = 0;
+	// cacheId 缓存的值使用弱引用, 长时间暂停时不阻止回收, 被回收后无法再展开
+	bool weakCache = false;
 
 	virtual nlohmann::json Serialize();
 
@@ -66,8 +84,15 @@ public:
 	std::string condition;
 	std::string hitCondition;
 	std::string logMessage;
-	int hitCount = 0;
+	// 命中次数, hook 线程递增, 其他线程可以随时读取
+	std::atomic<uint64_t> hitCount{0};
 	int line = 0;
+	// 添加断点时由 condition 编译, 无法本地求值时为空
+	std::shared_ptr<ConditionPredicate> conditionPredicate;
+	// 添加断点时由 logMessage 解析
+	std::shared_ptr<LogTemplate> logTemplate;
+	// 添加断点时由 hitCondition 解析
+	std::shared_ptr<HitCondition> hitConditionPredicate;
 
 	nlohmann::json Serialize() override;
 
@@ -103,21 +128,93 @@ public:
 };
 
 
-class Variable : public JsonProtocol {
+class VariableArena;
+
+/*
+ * 变量节点的句柄, 数据按列保存在 VariableArena 中, 复制句柄不复制节点
+ * 字符串保存在 arena 的字符串池中, 在 arena Clear 之前有效
+ */
+class Variable {
 public:
 	Variable();
 
-	std::string name;
-	int nameType = 0;
-	std::string value;
-	int valueType = 0;
-	std::string valueTypeName;
-	std::vector<Idx<Variable>> children;
-	int cacheId = 0;
+	Variable(VariableArena *arena, uint32_t id);
 
-	nlohmann::json Serialize() override;
+	VariableArena *GetArena() const;
 
-	void Deserialize(nlohmann::json json) override;
+	const char *GetName() const;
+	void SetName(const char *name);
+	void SetName(const char *name, std::size_t size);
+	void SetName(const std::string &name);
+
+	int GetNameType() const;
+	void SetNameType(int type);
+
+	const char *GetValue() const;
+	void SetValue(const char *value);
+	void SetValue(const char *value, std::size_t size);
+	void SetValue(const std::string &value);
+
+	int GetValueType() const;
+	void SetValueType(int type);
+
+	const char *GetValueTypeName() const;
+	void SetValueTypeName(const char *typeName);
+
+	int64_t GetCacheId() const;
+	void SetCacheId(int64_t id);
+
+	// 子节点受 tableChildrenLimit 限制没有全部列出
+	bool IsTruncated() const;
+	void SetTruncated(bool truncated);
+
+	// 追加到子节点末尾, 已经是其他节点的子节点或不在同一个 arena 中时忽略
+	void AddChild(Variable child);
+
+	bool HasChildren() const;
+
+	nlohmann::json Serialize() const;
+
+private:
+	VariableArena *_arena;
+	uint32_t _id;
+};
+
+/*
+ * 变量节点的存储, 每个字段一列, 分段分配, 节点地址不会因扩容移动
+ * Clear 后保留已分配的段和字符串块, 每次中断复用, 预热后不再分配内存
+ */
+class VariableArena {
+public:
+	Variable Alloc();
+
+	void Clear();
+
+	StringPool &GetStringPool();
+
+private:
+	friend class Variable;
+
+	static const uint32_t NoChild = UINT32_MAX;
+
+	enum Flag : uint8_t {
+		Truncated = 1,
+		// 已经挂在某个节点下
+		Linked = 2,
+	};
+
+	SegmentedArray<int32_t> _nameType;
+	SegmentedArray<int32_t> _valueType;
+	SegmentedArray<int64_t> _cacheId;
+	SegmentedArray<uint8_t> _flags;
+	// 子节点用链表连接, 保持添加顺序
+	SegmentedArray<uint32_t> _firstChild;
+	SegmentedArray<uint32_t> _lastChild;
+	SegmentedArray<uint32_t> _nextSibling;
+	SegmentedArray<const char *> _name;
+	SegmentedArray<const char *> _value;
+	SegmentedArray<const char *> _valueTypeName;
+	StringPool _strings;
 };
 
 class Stack : public JsonProtocol {
@@ -128,10 +225,13 @@ public:
 	std::string functionName;
 	int level = 0;
 	int line = 0;
-	std::vector<Idx<Variable>> localVariables;
-	std::vector<Idx<Variable>> upvalueVariables;
+	std::vector<Variable> localVariables;
+	std::vector<Variable> upvalueVariables;
+	// 为 false 时只发送栈帧位置, 不带变量
+	bool hasVariables = true;
 
-	std::shared_ptr<Arena<Variable>> variableArena;
+	// 变量所在的 arena, 由 Debugger 提供, 多个栈帧共用
+	std::shared_ptr<VariableArena> variableArena;
 
 	nlohmann::json Serialize() override;
 
@@ -142,14 +242,20 @@ class EvalContext : public JsonProtocol {
 public:
 	EvalContext();
 
+	// 结果分配在 arena 中, 用于多个求值共用一个 arena
+	explicit EvalContext(std::shared_ptr<VariableArena> arena);
+
+	// 复用时清空上一次的状态, result 重新从 arena 分配
+	void Reset();
+
 	std::string expr;
 	std::string value;
 	std::string error;
 	int seq = 0;
 	int stackLevel = 0;
 	int depth = 0;
-	int cacheId = 0;
-	Idx<Variable> result;
+	int64_t cacheId = 0;
+	Variable result;
 	bool success = false;
 	bool setValue = false;
 
@@ -157,7 +263,7 @@ public:
 
 	void Deserialize(nlohmann::json json) override;
 private:
-	Arena<Variable> _arena;
+	std::shared_ptr<VariableArena> _arena;
 };
 
 class EvalParams : public JsonProtocol {
@@ -168,3 +274,111 @@ public:
 
 	void Deserialize(nlohmann::json json) override;
 };
+
+class BatchEvalContext : public JsonProtocol {
+public:
+	int seq = 0;
+	int stackLevel = 0;
+	int depth = 0;
+	// 每一项的 stackLevel 都与 batch 相同
+	std::vector<std::shared_ptr<EvalContext>> evals;
+
+	nlohmann::json Serialize() override;
+
+	void Deserialize(nlohmann::json json) override;
+};
+
+class StackVariablesContext : public JsonProtocol {
+public:
+	int seq = 0;
+	int stackLevel = 0;
+	bool success = false;
+	Stack stack;
+
+	nlohmann::json Serialize() override;
+
+	void Deserialize(nlohmann::json json) override;
+};
+
+class StackVariablesParams : public JsonProtocol {
+public:
+	std::shared_ptr<StackVariablesContext> ctx;
+
+	nlohmann::json Serialize() override;
+
+	void Deserialize(nlohmann::json json) override;
+};
+
+/*
+ * 分页展开 cacheId 对应的表, 数组部分(1..#t)和哈希部分(其他键)分别指定 offset/limit
+ * 结果分多个响应发送, 每个响应只带本次新读取的子节点, 最后一个响应 done 为 true
+ */
+class ExpandVariableContext : public JsonProtocol {
+public:
+	int seq = 0;
+	int64_t cacheId = 0;
+	int depth = 1;
+	// limit 小于 0 表示读到末尾
+	int64_t arrayOffset = 0;
+	int64_t arrayLimit = -1;
+	int64_t hashOffset = 0;
+	int64_t hashLimit = -1;
+
+	bool success = false;
+	std::string error;
+	bool done = false;
+	int64_t arraySize = 0;
+	// 本次响应的子节点, 以及它们在数组部分和哈希部分的起始位置
+	std::vector<Variable> children;
+	int64_t chunkArrayOffset = 0;
+	int64_t chunkHashOffset = 0;
+
+	// 以下为分块读取的进度
+	bool started = false;
+	int64_t arrayNext = 0;
+	int64_t arrayEnd = 0;
+	// 哈希部分已经遍历的数量, 位置小于 hashSkip 的不返回
+	int64_t hashRead = 0;
+	int64_t hashSkip = 0;
+	// 哈希部分 lua_next 的位置在缓存表中的 id
+	int64_t cursorId = 0;
+
+	VariableArena *GetArena();
+
+	// 发送后清空本次的子节点
+	void ClearChunk();
+
+	nlohmann::json Serialize() override;
+
+	void Deserialize(nlohmann::json json) override;
+private:
+	VariableArena _arena;
+};
+
+class ExpandVariableParams : public JsonProtocol {
+public:
+	std::shared_ptr<ExpandVariableContext> ctx;
+
+	nlohmann::json Serialize() override;
+
+	void Deserialize(nlohmann::json json) override;
+};
+
+class SetWatchesParams : public JsonProtocol {
+public:
+	std::vector<std::string> watches;
+	int depth = 1;
+
+	nlohmann::json Serialize() override;
+
+	void Deserialize(nlohmann::json json) override;
+};
+
+class BatchEvalParams : public JsonProtocol {
+public:
+	std::shared_ptr<BatchEvalContext> ctx;
+
+	nlohmann::json Serialize() override;
+
+	void Deserialize(nlohmann::json json) override;
+};
@@ -19,6 +19,11 @@ interface Variable {
     nameType: VariableNameType;
     value: string;
     children?: Variable[];
+    // valid until the debugger resumes, 0 when the value is not cached
+    // up to 53 bits, always a safe integer
+    cacheId: number;
+    // children capped by InitReq.tableChildrenLimit, read the rest with ExpandVariableReq
+    truncated?: boolean;
 }
 
 interface Stack {
@@ -26,8 +31,9 @@ interface Stack {
     file: string;
     functionName: string;
     line: number;
-    localVariables: Variable[];
-    upvalueVariables: Variable[];
+    // omitted for frames other than the top one when InitReq.lazyStacks is set
+    localVariables?: Variable[];
+    upvalueVariables?: Variable[];
 }
 
 interface BreakPoint {
@@ -77,6 +83,8 @@ interface ActionRsp {
 // on break
 interface BreakNotify {
     stacks: Stack[];
+    // results of SetWatchesReq expressions in the top frame, in order
+    watches?: EvalRsp[];
 }
 
 interface EvalReq {
@@ -90,4 +98,69 @@ interface EvalRsp {
     success: boolean;
     error: string;
     value: Variable;
+}
+
+// read hit counts without breaking
+interface HitCountReq {
+}
+
+interface HitCountRsp {
+    breakPoints: BreakPoint[];
+}
+
+// evaluate several expressions in one stack frame, one response
+interface BatchEvalReq {
+    seq: number;
+    stackLevel: number;
+    depth: number;
+    // expression, or EvalReq without stackLevel
+    evals: (string | EvalReq)[];
+}
+
+interface BatchEvalRsp {
+    seq: number;
+    results: EvalRsp[];
+}
+
+// watch expressions evaluated on every break and sent with BreakNotify
+interface SetWatchesReq {
+    watches: string[];
+    depth: number;
+}
+
+// variables of one stack frame, for frames sent without them
+interface StackVariablesReq {
+    seq: number;
+    stackLevel: number;
+}
+
+interface StackVariablesRsp {
+    seq: number;
+    success: boolean;
+    stack: Stack;
+}
+
+// page through a table by cacheId, answered by one or more ExpandVariableRsp
+// the array part (1..#t) and the other keys are paged separately, a negative limit reads to the end
+interface ExpandVariableReq {
+    seq: number;
+    cacheId: number;
+    depth: number;
+    arrayOffset: number;
+    arrayLimit: number;
+    hashOffset: number;
+    hashLimit: number;
+}
+
+// children read since the previous response, the last one has done set
+interface ExpandVariableRsp {
+    seq: number;
+    success: boolean;
+    done: boolean;
+    error?: string;
+    arraySize: number;
+    // position of the first child in the array part and in the other keys
+    arrayOffset: number;
+    hashOffset: number;
+    children: Variable[];
 }
\ No newline at end of file
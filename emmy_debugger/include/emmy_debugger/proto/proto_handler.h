@@ -23,5 +23,15 @@ private:
 
 	void OnEvalReq(EvalParams& params);
 
+	void OnHitCountReq();
+
+	void OnBatchEvalReq(BatchEvalParams& params);
+
+	void OnSetWatchesReq(SetWatchesParams& params);
+
+	void OnStackVariablesReq(StackVariablesParams& params);
+
+	void OnExpandVariableReq(ExpandVariableParams& params);
+
 	EmmyFacade *_owner;
 };
@@ -51,6 +51,26 @@ enum class MessageCMD {
 
 	// debugger -> ide
 	LogNotify,
+
+	// 读取断点命中次数, 不需要中断
+	HitCountReq,
+	HitCountRsp,
+
+	// 同一栈帧的多个表达式一次求值, 一次回复
+	BatchEvalReq,
+	BatchEvalRsp,
+
+	// 设置监视表达式, 中断时随 BreakNotify 一起返回结果
+	SetWatchesReq,
+	SetWatchesRsp,
+
+	// 按需读取一个栈帧的变量
+	StackVariablesReq,
+	StackVariablesRsp,
+
+	// 分页展开表, 一个请求可能有多个响应
+	ExpandVariableReq,
+	ExpandVariableRsp,
 };
 
 class Transporter {
@@ -89,9 +89,11 @@ IMP_LUA_API(lua_setmetatable);
 IMP_LUA_API(lua_getstack);
 IMP_LUA_API(lua_getinfo);
 IMP_LUA_API(lua_getlocal);
+IMP_LUA_API(lua_setlocal);
 IMP_LUA_API(lua_getupvalue);
 IMP_LUA_API(lua_setupvalue);
 IMP_LUA_API(lua_sethook);
+IMP_LUA_API(lua_gethookmask);
 IMP_LUA_API(luaL_loadstring);
 IMP_LUA_API(luaL_checklstring);
 IMP_LUA_API(luaL_checknumber);
@@ -104,6 +106,9 @@ IMP_LUA_API(lua_touserdata);
 IMP_LUA_API(luaL_newstate);
 IMP_LUA_API(lua_close);
 IMP_LUA_API(lua_pushthread);
+IMP_LUA_API(lua_newthread);
+IMP_LUA_API(lua_xmove);
+IMP_LUA_API(lua_error);
 
 IMP_LUA_API(lua_rawseti);
 IMP_LUA_API(lua_rawgeti);
@@ -115,9 +120,16 @@ IMP_LUA_API_E(lua_call);
 IMP_LUA_API_E(lua_pcall);
 IMP_LUA_API_E(lua_remove);
 IMP_LUA_API_E(lua_insert);
+IMP_LUA_API_E(lua_resume);
+IMP_LUA_API_E(lua_resume_51);
+IMP_LUA_API_E(lua_resume_52);
+IMP_LUA_API_E(lua_getallocf);
+IMP_LUA_API_E(lua_setallocf);
+IMP_LUA_API_E(lua_objlen);
 // 52 53 54
 IMP_LUA_API_E(lua_rawgetp);
 IMP_LUA_API_E(lua_rawsetp);
+IMP_LUA_API_E(lua_rawlen);
 
 //53
 IMP_LUA_API_E(lua_tointegerx);
@@ -129,6 +141,7 @@ IMP_LUA_API_E(lua_pcallk);
 IMP_LUA_API_E(luaL_setfuncs);
 IMP_LUA_API_E(lua_absindex);
 IMP_LUA_API_E(lua_rotate);
+IMP_LUA_API_E(lua_isinteger);
 //51 & 52 & 53
 IMP_LUA_API_E(lua_newuserdata);
 //54
@@ -202,6 +215,25 @@ int getDebugLineDefined(lua_Debug* ar)
 	}
 }
 
+int getDebugLastLineDefined(lua_Debug* ar)
+{
+	switch (luaVersion)
+	{
+	case LuaVersion::LUA_JIT:
+	case LuaVersion::LUA_51:
+		return ar->u.ar51.lastlinedefined;
+	case LuaVersion::LUA_52:
+		return ar->u.ar52.lastlinedefined;
+	case LuaVersion::LUA_53:
+		return ar->u.ar53.lastlinedefined;
+	case LuaVersion::LUA_54:
+		return ar->u.ar54.lastlinedefined;
+	default:
+		assert(false);
+		return 0;
+	}
+}
+
 const char* getDebugSource(lua_Debug* ar)
 {
 	switch (luaVersion)
@@ -258,6 +290,15 @@ lua_Number lua_tonumber(lua_State* L, int idx)
 	return e_lua_tonumber(L, idx);
 }
 
+int lua_isinteger(lua_State* L, int idx)
+{
+	if (e_lua_isinteger)
+	{
+		return e_lua_isinteger(L, idx);
+	}
+	return 0;
+}
+
 int lua_getglobal(lua_State* L, const char* name)
 {
 	if (luaVersion > LuaVersion::LUA_51)
@@ -405,6 +446,63 @@ void lua_rawsetp(lua_State* L, int idx, const void* p)
 	}
 }
 
+int lua_resume(lua_State* L, lua_State* from, int narg, int* nres)
+{
+	if (luaVersion == LuaVersion::LUA_51 || luaVersion == LuaVersion::LUA_JIT)
+	{
+		*nres = 0;
+		const int r = e_lua_resume_51(L, narg);
+		if (r == LUA_OK || r == LUA_YIELD)
+		{
+			*nres = lua_gettop(L);
+		}
+		return r;
+	}
+	else if (luaVersion == LuaVersion::LUA_52 || luaVersion == LuaVersion::LUA_53)
+	{
+		*nres = 0;
+		const int r = e_lua_resume_52(L, from, narg);
+		if (r == LUA_OK || r == LUA_YIELD)
+		{
+			*nres = lua_gettop(L);
+		}
+		return r;
+	}
+	else
+	{
+		return e_lua_resume(L, from, narg, nres);
+	}
+}
+
+lua_Alloc lua_getallocf(lua_State* L, void** ud)
+{
+	if (!e_lua_getallocf || !e_lua_setallocf)
+	{
+		return nullptr;
+	}
+	return e_lua_getallocf(L, ud);
+}
+
+void lua_setallocf(lua_State* L, lua_Alloc f, void* ud)
+{
+	if (e_lua_setallocf)
+	{
+		e_lua_setallocf(L, f, ud);
+	}
+}
+
+size_t lua_rawlen(lua_State* L, int idx)
+{
+	if (luaVersion == LuaVersion::LUA_51 || luaVersion == LuaVersion::LUA_JIT)
+	{
+		return e_lua_objlen(L, idx);
+	}
+	else
+	{
+		return e_lua_rawlen(L, idx);
+	}
+}
+
 void lua_insert(lua_State* L, int idx)
 {
 	if (luaVersion == LuaVersion::LUA_51 || luaVersion == LuaVersion::LUA_52 || luaVersion == LuaVersion::LUA_JIT)
@@ -443,9 +541,11 @@ extern "C" bool SetupLuaAPI()
 	LOAD_LUA_API(lua_getstack);
 	LOAD_LUA_API(lua_getinfo);
 	LOAD_LUA_API(lua_getlocal);
+	LOAD_LUA_API(lua_setlocal);
 	LOAD_LUA_API(lua_getupvalue);
 	LOAD_LUA_API(lua_setupvalue);
 	LOAD_LUA_API(lua_sethook);
+	LOAD_LUA_API(lua_gethookmask);
 	LOAD_LUA_API(luaL_loadstring);
 	LOAD_LUA_API(luaL_checklstring);
 	LOAD_LUA_API(luaL_checknumber);
@@ -458,6 +558,9 @@ extern "C" bool SetupLuaAPI()
 	LOAD_LUA_API(luaL_newstate);
 	LOAD_LUA_API(lua_close);
 	LOAD_LUA_API(lua_pushthread);
+	LOAD_LUA_API(lua_newthread);
+	LOAD_LUA_API(lua_xmove);
+	LOAD_LUA_API(lua_error);
 
 	LOAD_LUA_API(lua_rawseti);
 	LOAD_LUA_API(lua_rawgeti);
@@ -469,6 +572,13 @@ extern "C" bool SetupLuaAPI()
 	LOAD_LUA_API_E(lua_pcall);
 	//51 & 52
 	LOAD_LUA_API_E(lua_remove);
+	LOAD_LUA_API_E(lua_insert);
+	LOAD_LUA_API_E(lua_resume);
+	LOAD_LUA_API_E_CPP(lua_resume_51, lua_resume);
+	LOAD_LUA_API_E_CPP(lua_resume_52, lua_resume);
+	LOAD_LUA_API_E(lua_getallocf);
+	LOAD_LUA_API_E(lua_setallocf);
+	LOAD_LUA_API_E(lua_objlen);
 	//52 & 53 & 54
 	LOAD_LUA_API_E(lua_tointegerx);
 	LOAD_LUA_API_E(lua_tonumberx);
@@ -480,12 +590,14 @@ extern "C" bool SetupLuaAPI()
 	LOAD_LUA_API_E(lua_absindex);
 	LOAD_LUA_API_E(lua_rawgetp);
 	LOAD_LUA_API_E(lua_rawsetp);
+	LOAD_LUA_API_E(lua_rawlen);
 
 
 	// 51 & 52 & 53
 	LOAD_LUA_API_E(lua_newuserdata);
 	//53
 	LOAD_LUA_API_E(lua_rotate);
+	LOAD_LUA_API_E(lua_isinteger);
 	//54
 	LOAD_LUA_API_E(lua_newuserdatauv);
 
@@ -513,9 +625,11 @@ extern "C" bool SetupLuaAPI()
 	LOAD_LUA_API_CPP(lua_getstack, ?lua_getstack@@YAHPEAUlua_State@@HPEAUlua_Debug@@@Z);
 	LOAD_LUA_API_CPP(lua_getinfo, ?lua_getinfo@@YAHPEAUlua_State@@PEBDPEAUlua_Debug@@@Z);
 	LOAD_LUA_API_CPP(lua_getlocal, ?lua_getlocal@@YAPEBDPEAUlua_State@@PEBUlua_Debug@@H@Z);
+	LOAD_LUA_API_CPP(lua_setlocal, ?lua_setlocal@@YAPEBDPEAUlua_State@@PEBUlua_Debug@@H@Z);
 	LOAD_LUA_API_CPP(lua_getupvalue, ?lua_getupvalue@@YAPEBDPEAUlua_State@@HH@Z);
 	LOAD_LUA_API_CPP(lua_setupvalue, ?lua_setupvalue@@YAPEBDPEAUlua_State@@HH@Z);
 	LOAD_LUA_API_CPP(lua_sethook, ?lua_sethook@@YAXPEAUlua_State@@P6AX0PEAUlua_Debug@@@ZHH@Z);
+	LOAD_LUA_API_CPP(lua_gethookmask, ?lua_gethookmask@@YAHPEAUlua_State@@@Z);
 	LOAD_LUA_API_CPP(luaL_loadstring, ?luaL_loadstring@@YAHPEAUlua_State@@PEBD@Z);
 	LOAD_LUA_API_CPP(luaL_checklstring, ?luaL_checklstring@@YAPEBDPEAUlua_State@@HPEA_K@Z);
 	LOAD_LUA_API_CPP(luaL_checknumber, ?luaL_checknumber@@YANPEAUlua_State@@H@Z);
@@ -528,6 +642,9 @@ extern "C" bool SetupLuaAPI()
 	LOAD_LUA_API_CPP(luaL_newstate, ?luaL_newstate@@YAPEAUlua_State@@XZ);
 	LOAD_LUA_API_CPP(lua_close, ?lua_close@@YAXPEAUlua_State@@@Z);
 	LOAD_LUA_API_CPP(lua_pushthread, ?lua_pushthread@@YAHPEAUlua_State@@@Z);
+	LOAD_LUA_API_CPP(lua_newthread, ?lua_newthread@@YAPEAUlua_State@@PEAU1@@Z);
+	LOAD_LUA_API_CPP(lua_xmove, ?lua_xmove@@YAXPEAUlua_State@@0H@Z);
+	LOAD_LUA_API_CPP(lua_error, ?lua_error@@YAHPEAUlua_State@@@Z);
 
 	LOAD_LUA_API_CPP(lua_rawseti, ?lua_rawseti@@YAXPEAUlua_State@@H_J@Z);
 	LOAD_LUA_API_CPP(lua_rawgeti, ?lua_rawgeti@@YAHPEAUlua_State@@H_J@Z);
@@ -539,6 +656,13 @@ extern "C" bool SetupLuaAPI()
 	LOAD_LUA_API_E_CPP(lua_pcall, lua_pcall);
 	//51 & 52
 	LOAD_LUA_API_E_CPP(lua_remove, lua_remove);
+	LOAD_LUA_API_E_CPP(lua_insert, lua_insert);
+	LOAD_LUA_API_E_CPP(lua_resume, ?lua_resume@@YAHPEAUlua_State@@0HPEAH@Z);
+	LOAD_LUA_API_E_CPP(lua_resume_51, ?lua_resume@@YAHPEAUlua_State@@H@Z);
+	LOAD_LUA_API_E_CPP(lua_resume_52, ?lua_resume@@YAHPEAUlua_State@@0H@Z);
+	LOAD_LUA_API_E_CPP(lua_getallocf, ?lua_getallocf@@YAP6APEAXPEAX0_K1@ZPEAUlua_State@@PEAPEAX@Z);
+	LOAD_LUA_API_E_CPP(lua_setallocf, ?lua_setallocf@@YAXPEAUlua_State@@P6APEAXPEAX1_K2@Z1@Z);
+	LOAD_LUA_API_E_CPP(lua_objlen, ?lua_objlen@@YA_KPEAUlua_State@@H@Z);
 	//52 & 53 & 54
 	LOAD_LUA_API_E_CPP(lua_tointegerx, ?lua_tointegerx@@YA_JPEAUlua_State@@HPEAH@Z);
 	LOAD_LUA_API_E_CPP(lua_tonumberx, ?lua_tonumberx@@YANPEAUlua_State@@HPEAH@Z);
@@ -550,12 +674,14 @@ extern "C" bool SetupLuaAPI()
 	LOAD_LUA_API_E_CPP(lua_absindex, ?lua_absindex@@YAHPEAUlua_State@@H@Z);
 	LOAD_LUA_API_E_CPP(lua_rawgetp, ?lua_rawgetp@@YAHPEAUlua_State@@HPEBX@Z);
 	LOAD_LUA_API_E_CPP(lua_rawsetp, ?lua_rawsetp@@YAXPEAUlua_State@@HPEBX@Z);
+	LOAD_LUA_API_E_CPP(lua_rawlen, ?lua_rawlen@@YA_KPEAUlua_State@@H@Z);
 
 
 	// 51 & 52 & 53
 	LOAD_LUA_API_E_CPP(lua_newuserdata, lua_newuserdata);
 	//53
 	LOAD_LUA_API_E_CPP(lua_rotate, ?lua_rotate@@YAXPEAUlua_State@@HH@Z);
+	LOAD_LUA_API_E_CPP(lua_isinteger, ?lua_isinteger@@YAHPEAUlua_State@@H@Z);
 	//54
 	LOAD_LUA_API_E_CPP(lua_newuserdatauv, ?lua_newuserdatauv@@YAPEAXPEAUlua_State@@_KH@Z);
 
@@ -63,4 +63,64 @@ std::vector<lua_State*> FindAllCoroutine(lua_State* L)
 		FindAllCoroutine_lua54(L),
 		std::vector<lua_State*>()
 	);
-}
\ No newline at end of file
+}
+
+intptr_t GetCurrentCallInfo(lua_State* L)
+{
+	LuaSwitchDo(
+		0,
+		GetCurrentCallInfo_lua51(L),
+		GetCurrentCallInfo_lua52(L),
+		GetCurrentCallInfo_lua53(L),
+		GetCurrentCallInfo_lua54(L),
+		0
+	);
+}
+
+std::vector<intptr_t> GetCallInfos(lua_State* L)
+{
+	LuaSwitchDo(
+		std::vector<intptr_t>(),
+		GetCallInfos_lua51(L),
+		GetCallInfos_lua52(L),
+		GetCallInfos_lua53(L),
+		GetCallInfos_lua54(L),
+		std::vector<intptr_t>()
+	);
+}
+
+bool GetFunctionDebugInfo(lua_State* L, FunctionDebugInfo& info, bool withVariables)
+{
+	LuaSwitchDo(
+		false,
+		GetFunctionDebugInfo_lua51(L, info, withVariables),
+		GetFunctionDebugInfo_lua52(L, info, withVariables),
+		GetFunctionDebugInfo_lua53(L, info, withVariables),
+		GetFunctionDebugInfo_lua54(L, info, withVariables),
+		false
+	);
+}
+
+bool GetTableShape(lua_State* L, TableShape& shape)
+{
+	LuaSwitchDo(
+		false,
+		GetTableShape_lua51(L, shape),
+		GetTableShape_lua52(L, shape),
+		GetTableShape_lua53(L, shape),
+		GetTableShape_lua54(L, shape),
+		false
+	);
+}
+
+bool PushSourceString(lua_State* L, const char* source)
+{
+	LuaSwitchDo(
+		false,
+		PushSourceString_lua51(L, source),
+		PushSourceString_lua52(L, source),
+		PushSourceString_lua53(L, source),
+		PushSourceString_lua54(L, source),
+		false
+	);
+}
@@ -1,8 +1,10 @@
 ﻿#include "emmy_debugger/api/lua_state.h"
 #ifdef EMMY_USE_LUA_SOURCE
 #include "lstate.h"
+#include "ltable.h"
 #else
 #include "lua-5.1.5/src/lstate.h"
+#include "lua-5.1.5/src/ltable.h"
 #endif
 
 
@@ -27,4 +29,73 @@ std::vector<lua_State*> FindAllCoroutine_lua51(lua_State* L)
 	}
 
 	return result;
-}
\ No newline at end of file
+}
+
+intptr_t GetCurrentCallInfo_lua51(lua_State* L)
+{
+	// CallInfo 是连续数组, 下标就是深度
+	return L->ci - L->base_ci;
+}
+
+std::vector<intptr_t> GetCallInfos_lua51(lua_State* L)
+{
+	std::vector<intptr_t> result;
+	for (intptr_t i = 1; i <= L->ci - L->base_ci; i++)
+	{
+		result.push_back(i);
+	}
+	return result;
+}
+
+bool GetFunctionDebugInfo_lua51(lua_State* L, FunctionDebugInfo& info, bool withVariables)
+{
+	const TValue* o = L->top - 1;
+	if (!(ttisfunction(o) && !clvalue(o)->c.isC))
+	{
+		return false;
+	}
+	const Proto* p = clvalue(o)->l.p;
+	info.proto = p;
+	info.code = p->code;
+	info.lineDefined = p->linedefined;
+	info.locVars.clear();
+	info.upvalues.clear();
+	if (!withVariables)
+	{
+		return true;
+	}
+	for (int i = 0; i < p->sizelocvars; i++)
+	{
+		info.locVars.push_back({getstr(p->locvars[i].varname), p->locvars[i].startpc, p->locvars[i].endpc});
+	}
+	for (int i = 0; i < p->sizeupvalues; i++)
+	{
+		info.upvalues.push_back(p->upvalues && p->upvalues[i] ? getstr(p->upvalues[i]) : "");
+	}
+	return true;
+}
+
+bool GetTableShape_lua51(lua_State* L, TableShape& shape)
+{
+	const TValue* o = L->top - 1;
+	if (!ttistable(o))
+	{
+		return false;
+	}
+	const Table* t = hvalue(o);
+	shape.arraySize = static_cast<size_t>(t->sizearray);
+	shape.hashSize = sizenode(t);
+	shape.estimated = false;
+	shape.arrayUsed = CountArraySlots(shape.arraySize, [t](size_t i) { return !ttisnil(&t->array[i]); }, shape.estimated);
+	shape.hashUsed = CountTableSlots(shape.hashSize, [t](size_t i) { return !ttisnil(gval(gnode(t, i))); }, shape.estimated);
+	return true;
+}
+
+bool PushSourceString_lua51(lua_State* L, const char* source)
+{
+	// getstr(ts) 紧跟在 TString 之后
+	const auto ts = reinterpret_cast<TString*>(const_cast<char*>(source)) - 1;
+	setsvalue2s(L, L->top, ts);
+	L->top++;
+	return true;
+}
@@ -1,8 +1,11 @@
 ﻿#include "emmy_debugger/api/lua_state.h"
+#include <algorithm>
 #ifdef EMMY_USE_LUA_SOURCE
 #include "lstate.h"
+#include "ltable.h"
 #else
 #include "lua-5.4.6/src/lstate.h"
+#include "lua-5.4.6/src/ltable.h"
 #endif
 
 lua_State* GetMainState_lua54(lua_State* L)
@@ -25,4 +28,83 @@ std::vector<lua_State*> FindAllCoroutine_lua54(lua_State* L)
 	}
 
 	return result;
-}
\ No newline at end of file
+}
+
+intptr_t GetCurrentCallInfo_lua54(lua_State* L)
+{
+	return reinterpret_cast<intptr_t>(L->ci);
+}
+
+std::vector<intptr_t> GetCallInfos_lua54(lua_State* L)
+{
+	std::vector<intptr_t> result;
+	for (auto ci = L->ci; ci != &L->base_ci; ci = ci->previous)
+	{
+		result.push_back(reinterpret_cast<intptr_t>(ci));
+	}
+	std::reverse(result.begin(), result.end());
+	return result;
+}
+
+bool GetFunctionDebugInfo_lua54(lua_State* L, FunctionDebugInfo& info, bool withVariables)
+{
+	const TValue* o = s2v(L->top.p - 1);
+	if (!ttisLclosure(o))
+	{
+		return false;
+	}
+	const Proto* p = clLvalue(o)->p;
+	info.proto = p;
+	info.code = p->code;
+	info.lineDefined = p->linedefined;
+	info.locVars.clear();
+	info.upvalues.clear();
+	if (!withVariables)
+	{
+		return true;
+	}
+	for (int i = 0; i < p->sizelocvars; i++)
+	{
+		info.locVars.push_back({getstr(p->locvars[i].varname), p->locvars[i].startpc, p->locvars[i].endpc});
+	}
+	for (int i = 0; i < p->sizeupvalues; i++)
+	{
+		info.upvalues.push_back(p->upvalues[i].name ? getstr(p->upvalues[i].name) : "");
+	}
+	return true;
+}
+
+bool GetTableShape_lua54(lua_State* L, TableShape& shape)
+{
+	const TValue* o = s2v(L->top.p - 1);
+	if (!ttistable(o))
+	{
+		return false;
+	}
+	const Table* t = hvalue(o);
+	// alimit 不一定是数组部分的实际大小, 与 luaH_realasize 相同的算法
+	size_t arraySize = t->alimit;
+	if (!isrealasize(t) && (arraySize & (arraySize - 1)) != 0)
+	{
+		size_t size = 1;
+		while (size < arraySize)
+		{
+			size <<= 1;
+		}
+		arraySize = size;
+	}
+	shape.arraySize = arraySize;
+	shape.hashSize = sizenode(t);
+	shape.estimated = false;
+	shape.arrayUsed = CountArraySlots(shape.arraySize, [t](size_t i) { return !isempty(&t->array[i]); }, shape.estimated);
+	shape.hashUsed = CountTableSlots(shape.hashSize, [t](size_t i) { return !isempty(gval(gnode(t, i))); }, shape.estimated);
+	return true;
+}
+
+bool PushSourceString_lua54(lua_State* L, const char* source)
+{
+	const auto ts = reinterpret_cast<TString*>(const_cast<char*>(source) - offsetof(TString, contents));
+	setsvalue2s(L, L->top.p, ts);
+	L->top.p++;
+	return true;
+}
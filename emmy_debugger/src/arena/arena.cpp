@@ -1 +1,37 @@
-#include "emmy_debugger/arena/arena.h"
\ No newline at end of file
+#include "emmy_debugger/arena/arena.h"
+#include <cstring>
+
+StringPool::StringPool()
+	: _block(0), _used(0) {
+}
+
+const char *StringPool::Store(const char *data, std::size_t size) {
+	if (size == 0) {
+		return "";
+	}
+	const std::size_t need = size + 1;
+	char *p = nullptr;
+	if (need > BlockSize) {
+		_largeBlocks.emplace_back(new char[need]);
+		p = _largeBlocks.back().get();
+	} else {
+		if (_block < _blocks.size() && BlockSize - _used < need) {
+			_block++;
+			_used = 0;
+		}
+		if (_block == _blocks.size()) {
+			_blocks.emplace_back(new char[BlockSize]);
+		}
+		p = _blocks[_block].get() + _used;
+		_used += need;
+	}
+	std::memcpy(p, data, size);
+	p[size] = '\0';
+	return p;
+}
+
+void StringPool::Clear() {
+	_largeBlocks.clear();
+	_block = 0;
+	_used = 0;
+}
@@ -0,0 +1,187 @@
+#include "emmy_debugger/debugger/breakpoint_index.h"
+#include <algorithm>
+#include <cctype>
+#include "emmy_debugger/util.h"
+
+BreakpointIndex::BreakpointIndex(const BreakpointList &breakpoints, const std::vector<std::string> &extNames,
+                                 uint64_t version)
+	: version(version) {
+	for (auto &ext: extNames) {
+		std::string lowerExt = ext;
+		std::transform(lowerExt.begin(), lowerExt.end(), lowerExt.begin(), ::tolower);
+		this->extNames.push_back(lowerExt);
+	}
+
+	// 根节点
+	nodes.emplace_back();
+
+	std::unordered_map<std::string, int> fileIds;
+	for (auto &bp: breakpoints) {
+		lines.insert(bp->line);
+
+		const auto path = NormalizePath(bp->file);
+		auto it = fileIds.find(path);
+		if (it == fileIds.end()) {
+			const int id = static_cast<int>(files.size());
+			files.emplace_back();
+			it = fileIds.emplace(path, id).first;
+
+			int node = 0;
+			for (auto c = path.rbegin(); c != path.rend(); ++c) {
+				int child = FindChild(node, *c);
+				if (child < 0) {
+					child = static_cast<int>(nodes.size());
+					nodes.emplace_back();
+					nodes[node].children.emplace_back(*c, child);
+				}
+				node = child;
+			}
+			if (nodes[node].file < 0) {
+				nodes[node].file = id;
+			}
+		}
+		// 同一文件同一行有多个断点时以先加入的为准
+		if (files[it->second].lines.emplace(bp->line, bp).second) {
+			files[it->second].sortedLines.push_back(bp->line);
+		}
+	}
+
+	for (auto &file: files) {
+		std::sort(file.sortedLines.begin(), file.sortedLines.end());
+	}
+}
+
+bool BreakpointIndex::Empty() const {
+	return lines.empty();
+}
+
+uint64_t BreakpointIndex::GetVersion() const {
+	return version;
+}
+
+bool BreakpointIndex::HasLine(int line) const {
+	return lines.find(line) != lines.end();
+}
+
+void BreakpointIndex::MatchFiles(const std::string &chunkName, std::vector<int> &matchFiles) const {
+	matchFiles.clear();
+	if (files.empty()) {
+		return;
+	}
+
+	const auto path = NormalizePath(chunkName);
+
+	// 路径上经过的文件是 chunkname 的后缀
+	std::vector<int> suffixFiles;
+	int node = 0;
+	bool consumed = true;
+	for (auto c = path.rbegin(); c != path.rend(); ++c) {
+		node = FindChild(node, *c);
+		if (node < 0) {
+			consumed = false;
+			break;
+		}
+		if (nodes[node].file >= 0 && c + 1 != path.rend()) {
+			suffixFiles.push_back(nodes[node].file);
+		}
+	}
+
+	// chunkname 完全走完时, 子树中的文件都以 chunkname 为后缀, 匹配度相同，按加入顺序排列
+	if (consumed) {
+		CollectFiles(node, matchFiles);
+		std::sort(matchFiles.begin(), matchFiles.end());
+	}
+
+	// 更长的后缀匹配度更高
+	matchFiles.insert(matchFiles.end(), suffixFiles.rbegin(), suffixFiles.rend());
+}
+
+std::shared_ptr<BreakPoint> BreakpointIndex::FindBreakPoint(const std::vector<int> &matchFiles, int line) const {
+	for (auto file: matchFiles) {
+		auto &fileLines = files[file].lines;
+		auto it = fileLines.find(line);
+		if (it != fileLines.end()) {
+			return it->second;
+		}
+	}
+	return nullptr;
+}
+
+bool BreakpointIndex::HasBreakPointInRange(const std::vector<int> &matchFiles, int firstLine, int lastLine) const {
+	for (auto file: matchFiles) {
+		auto &sortedLines = files[file].sortedLines;
+		auto it = std::lower_bound(sortedLines.begin(), sortedLines.end(), firstLine);
+		if (it != sortedLines.end() && *it <= lastLine) {
+			return true;
+		}
+	}
+	return false;
+}
+
+std::string BreakpointIndex::NormalizePath(const std::string &path) const {
+	// load 时给出的 chunkname 可能是 =name 的形式
+	std::string lowerPath = (!path.empty() && path[0] == '=') ? path.substr(1) : path;
+	for (auto &c: lowerPath) {
+		c = static_cast<char>(::tolower(static_cast<unsigned char>(c)));
+		if (c == '\\') {
+			c = '/';
+		}
+	}
+
+	// trim 掉后缀
+	std::size_t extSize = 0;
+	for (const auto &ext: extNames) {
+		if (ext.size() > extSize && EndWith(lowerPath, ext)) {
+			extSize = ext.size();
+		}
+	}
+	lowerPath.resize(lowerPath.size() - extSize);
+
+	// chunkname有可能是(./aaaa)也可能是(aaa/./bbb), 也有人写出 .\\/aaaa 这样的路径
+	// 并不处理(../)的情况，因为 ../的路径意义并不唯一
+	std::string result;
+	result.reserve(lowerPath.size());
+	if (!lowerPath.empty() && lowerPath[0] == '/') {
+		result.push_back('/');
+	}
+
+	std::size_t start = 0;
+	while (start <= lowerPath.size()) {
+		auto end = lowerPath.find('/', start);
+		if (end == std::string::npos) {
+			end = lowerPath.size();
+		}
+		const auto size = end - start;
+		if (size != 0 && !(size == 1 && lowerPath[start] == '.')) {
+			if (!result.empty() && result.back() != '/') {
+				result.push_back('/');
+			}
+			result.append(lowerPath, start, size);
+		}
+		start = end + 1;
+	}
+	return result;
+}
+
+int BreakpointIndex::FindChild(int node, char c) const {
+	for (auto &child: nodes[node].children) {
+		if (child.first == c) {
+			return child.second;
+		}
+	}
+	return -1;
+}
+
+void BreakpointIndex::CollectFiles(int node, std::vector<int> &matchFiles) const {
+	std::vector<int> stack = {node};
+	while (!stack.empty()) {
+		const int current = stack.back();
+		stack.pop_back();
+		if (nodes[current].file >= 0) {
+			matchFiles.push_back(nodes[current].file);
+		}
+		for (auto &child: nodes[current].children) {
+			stack.push_back(child.second);
+		}
+	}
+}
@@ -0,0 +1,470 @@
+#include "emmy_debugger/debugger/condition_predicate.h"
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+// 绝对值不超过它的整数转换成 double 不丢失精度
+const int64_t MAX_EXACT_INTEGER = static_cast<int64_t>(1) << 53;
+}
+
+class ConditionPredicate::Parser {
+public:
+	Parser(const std::string &text, ConditionPredicate &predicate)
+		: text(text), pos(0), predicate(predicate) {
+	}
+
+	bool Parse() {
+		SkipSpace();
+		// 单独的路径
+		const auto start = pos;
+		Operand operand;
+		if (ParseOperand(operand) && operand.kind == Operand::Kind::Path) {
+			SkipSpace();
+			if (pos == text.size()) {
+				Node node;
+				node.type = Node::Type::Truthy;
+				node.lhs = std::move(operand);
+				predicate.root = AddNode(std::move(node));
+				return true;
+			}
+		}
+		pos = start;
+
+		const int root = ParseOr();
+		SkipSpace();
+		if (root < 0 || pos != text.size()) {
+			return false;
+		}
+		predicate.root = root;
+		return true;
+	}
+
+private:
+	int AddNode(Node &&node) {
+		predicate.nodes.push_back(std::move(node));
+		return static_cast<int>(predicate.nodes.size()) - 1;
+	}
+
+	int ParseOr() {
+		int left = ParseAnd();
+		while (left >= 0 && ParseKeyword("or")) {
+			const int right = ParseAnd();
+			if (right < 0) {
+				return -1;
+			}
+			Node node;
+			node.type = Node::Type::Or;
+			node.left = left;
+			node.right = right;
+			left = AddNode(std::move(node));
+		}
+		return left;
+	}
+
+	int ParseAnd() {
+		int left = ParseCompare();
+		while (left >= 0 && ParseKeyword("and")) {
+			const int right = ParseCompare();
+			if (right < 0) {
+				return -1;
+			}
+			Node node;
+			node.type = Node::Type::And;
+			node.left = left;
+			node.right = right;
+			left = AddNode(std::move(node));
+		}
+		return left;
+	}
+
+	int ParseCompare() {
+		Node node;
+		node.type = Node::Type::Compare;
+		if (!ParseOperand(node.lhs) || !ParseCompareOp(node.op) || !ParseOperand(node.rhs)) {
+			return -1;
+		}
+		return AddNode(std::move(node));
+	}
+
+	bool ParseCompareOp(CompareOp &op) {
+		SkipSpace();
+		if (Match("==")) {
+			op = CompareOp::Eq;
+		} else if (Match("~=")) {
+			op = CompareOp::Ne;
+		} else if (Match("<=")) {
+			op = CompareOp::Le;
+		} else if (Match(">=")) {
+			op = CompareOp::Ge;
+		} else if (Match("<")) {
+			op = CompareOp::Lt;
+		} else if (Match(">")) {
+			op = CompareOp::Gt;
+		} else {
+			return false;
+		}
+		return true;
+	}
+
+	bool ParseOperand(Operand &operand) {
+		SkipSpace();
+		if (pos >= text.size()) {
+			return false;
+		}
+		const char c = text[pos];
+		if (c == '"' || c == '\'') {
+			operand.kind = Operand::Kind::String;
+			return ParseString(operand.str);
+		}
+		if (std::isdigit(static_cast<unsigned char>(c)) || c == '-' || c == '.') {
+			operand.kind = Operand::Kind::Number;
+			return ParseNumber(operand);
+		}
+
+		const auto start = pos;
+		std::string name;
+		if (!ParseName(name)) {
+			return false;
+		}
+		if (name == "nil") {
+			operand.kind = Operand::Kind::Nil;
+			return true;
+		}
+		if (name == "true" || name == "false") {
+			operand.kind = Operand::Kind::Boolean;
+			operand.boolean = name == "true";
+			return true;
+		}
+
+		pos = start;
+		operand.kind = Operand::Kind::Path;
+		return VariablePath::Parse(text, pos, operand.path);
+	}
+
+	bool ParseName(std::string &name) {
+		if (pos >= text.size()) {
+			return false;
+		}
+		const char c = text[pos];
+		if (!std::isalpha(static_cast<unsigned char>(c)) && c != '_') {
+			return false;
+		}
+		const auto start = pos;
+		while (pos < text.size() && (std::isalnum(static_cast<unsigned char>(text[pos])) || text[pos] == '_')) {
+			pos++;
+		}
+		name = text.substr(start, pos - start);
+		return true;
+	}
+
+	// 不含转义和换行的字符串
+	bool ParseString(std::string &str) {
+		const char quote = text[pos++];
+		const auto start = pos;
+		while (pos < text.size() && text[pos] != quote) {
+			if (text[pos] == '\\' || text[pos] == '\n' || text[pos] == '\r') {
+				return false;
+			}
+			pos++;
+		}
+		if (pos >= text.size()) {
+			return false;
+		}
+		str = text.substr(start, pos - start);
+		pos++;
+		return true;
+	}
+
+	// 十进制数字, 其他写法交给lua
+	bool ParseNumber(Operand &operand) {
+		const auto start = pos;
+		if (text[pos] == '-') {
+			pos++;
+		}
+		bool digits = false;
+		bool isFloat = false;
+		while (pos < text.size()) {
+			const char c = text[pos];
+			if (std::isdigit(static_cast<unsigned char>(c))) {
+				digits = true;
+			} else if (c == 'e' || c == 'E') {
+				isFloat = true;
+				if (pos + 1 < text.size() && (text[pos + 1] == '+' || text[pos + 1] == '-')) {
+					pos++;
+				}
+			} else if (c == '.') {
+				isFloat = true;
+			} else {
+				break;
+			}
+			pos++;
+		}
+		if (!digits || (pos < text.size() && (std::isalpha(static_cast<unsigned char>(text[pos])) || text[pos] == '_'))) {
+			return false;
+		}
+		const std::string token = text.substr(start, pos - start);
+		char *end = nullptr;
+		if (!isFloat) {
+			// 和lua 一样, 超出范围的整数字面量按浮点数处理
+			errno = 0;
+			const long long integer = std::strtoll(token.c_str(), &end, 10);
+			if (errno == 0 && end == token.c_str() + token.size()) {
+				operand.isInteger = true;
+				operand.integer = static_cast<int64_t>(integer);
+				operand.number = static_cast<lua_Number>(integer);
+				return true;
+			}
+		}
+		operand.number = std::strtod(token.c_str(), &end);
+		return end == token.c_str() + token.size();
+	}
+
+	bool ParseKeyword(const char *keyword) {
+		SkipSpace();
+		const auto len = std::strlen(keyword);
+		if (text.compare(pos, len, keyword) != 0) {
+			return false;
+		}
+		const auto next = pos + len;
+		if (next < text.size() && (std::isalnum(static_cast<unsigned char>(text[next])) || text[next] == '_')) {
+			return false;
+		}
+		pos = next;
+		return true;
+	}
+
+	bool Match(const char *token) {
+		const auto len = std::strlen(token);
+		if (text.compare(pos, len, token) != 0) {
+			return false;
+		}
+		pos += len;
+		return true;
+	}
+
+	void SkipSpace() {
+		while (pos < text.size() && std::isspace(static_cast<unsigned char>(text[pos]))) {
+			pos++;
+		}
+	}
+
+	const std::string &text;
+	std::size_t pos;
+	ConditionPredicate &predicate;
+};
+
+std::shared_ptr<ConditionPredicate> ConditionPredicate::Compile(const std::string &condition) {
+	if (condition.empty()) {
+		return nullptr;
+	}
+	auto predicate = std::make_shared<ConditionPredicate>();
+	Parser parser(condition, *predicate);
+	if (!parser.Parse()) {
+		return nullptr;
+	}
+	return predicate;
+}
+
+ConditionPredicate::Result ConditionPredicate::Evaluate(lua_State *L, int level) const {
+	Frame frame{};
+	frame.L = L;
+	if (root < 0 || !lua_getstack(L, level, &frame.ar)) {
+		return Result::Unknown;
+	}
+
+	const int top = lua_gettop(L);
+	const auto result = EvaluateNode(frame, root);
+	lua_settop(L, top);
+	return result;
+}
+
+ConditionPredicate::Result ConditionPredicate::EvaluateNode(Frame &frame, int index) const {
+	const auto &node = nodes[index];
+	switch (node.type) {
+		case Node::Type::Or: {
+			const auto left = EvaluateNode(frame, node.left);
+			if (left != Result::False) {
+				return left;
+			}
+			return EvaluateNode(frame, node.right);
+		}
+		case Node::Type::And: {
+			const auto left = EvaluateNode(frame, node.left);
+			if (left != Result::True) {
+				return left;
+			}
+			return EvaluateNode(frame, node.right);
+		}
+		case Node::Type::Compare: {
+			const int top = lua_gettop(frame.L);
+			Value lhs, rhs;
+			auto result = Result::Unknown;
+			if (ReadOperand(frame, node.lhs, lhs) && ReadOperand(frame, node.rhs, rhs)) {
+				result = Compare(lhs, rhs, node.op);
+			}
+			lua_settop(frame.L, top);
+			return result;
+		}
+		case Node::Type::Truthy: {
+			const int top = lua_gettop(frame.L);
+			Value value;
+			auto result = Result::Unknown;
+			if (ReadOperand(frame, node.lhs, value)) {
+				// lua 求值要求结果是布尔值 true
+				result = value.type == LUA_TBOOLEAN && value.boolean ? Result::True : Result::False;
+			}
+			lua_settop(frame.L, top);
+			return result;
+		}
+	}
+	return Result::Unknown;
+}
+
+bool ConditionPredicate::ReadOperand(Frame &frame, const Operand &operand, Value &value) const {
+	switch (operand.kind) {
+		case Operand::Kind::Nil:
+			value.type = LUA_TNIL;
+			return true;
+		case Operand::Kind::Boolean:
+			value.type = LUA_TBOOLEAN;
+			value.boolean = operand.boolean;
+			return true;
+		case Operand::Kind::Number:
+			value.type = LUA_TNUMBER;
+			value.isInteger = operand.isInteger;
+			value.integer = operand.integer;
+			value.number = operand.number;
+			return true;
+		case Operand::Kind::String:
+			value.type = LUA_TSTRING;
+			value.str = operand.str.c_str();
+			value.len = operand.str.size();
+			return true;
+		case Operand::Kind::Path:
+			break;
+	}
+
+	auto L = frame.L;
+	if (!operand.path.Push(L, &frame.ar)) {
+		return false;
+	}
+
+	value.type = lua_type(L, -1);
+	switch (value.type) {
+		case LUA_TBOOLEAN:
+			value.boolean = lua_toboolean(L, -1) != 0;
+			break;
+		case LUA_TNUMBER:
+			if (lua_isinteger(L, -1)) {
+				value.isInteger = true;
+				value.integer = lua_tointeger(L, -1);
+			} else {
+				value.number = lua_tonumber(L, -1);
+			}
+			break;
+		case LUA_TSTRING:
+			value.str = lua_tolstring(L, -1, &value.len);
+			break;
+		case LUA_TNIL:
+			break;
+		default:
+			value.pointer = lua_topointer(L, -1);
+			break;
+	}
+	return true;
+}
+
+ConditionPredicate::Result ConditionPredicate::Compare(const Value &lhs, const Value &rhs, CompareOp op) {
+	switch (op) {
+		case CompareOp::Eq:
+		case CompareOp::Ne: {
+			bool equal = false;
+			if (lhs.type == rhs.type) {
+				switch (lhs.type) {
+					case LUA_TNIL:
+						equal = true;
+						break;
+					case LUA_TBOOLEAN:
+						equal = lhs.boolean == rhs.boolean;
+						break;
+					case LUA_TNUMBER:
+						return CompareNumber(lhs, rhs, op);
+					case LUA_TSTRING:
+						equal = lhs.len == rhs.len && std::memcmp(lhs.str, rhs.str, lhs.len) == 0;
+						break;
+					case LUA_TTABLE:
+					case LUA_TUSERDATA:
+						// 不同的对象可能有 __eq
+						if (lhs.pointer != rhs.pointer) {
+							return Result::Unknown;
+						}
+						equal = true;
+						break;
+					default:
+						equal = lhs.pointer == rhs.pointer;
+						break;
+				}
+			}
+			return equal == (op == CompareOp::Eq) ? Result::True : Result::False;
+		}
+		default:
+			break;
+	}
+
+	// 只比较数字, 字符串和其他类型交给lua
+	if (lhs.type != LUA_TNUMBER || rhs.type != LUA_TNUMBER) {
+		return Result::Unknown;
+	}
+	return CompareNumber(lhs, rhs, op);
+}
+
+ConditionPredicate::Result ConditionPredicate::CompareNumber(const Value &lhs, const Value &rhs, CompareOp op) {
+	if (lhs.isInteger && rhs.isInteger) {
+		return CompareOrdered(lhs.integer, rhs.integer, op);
+	}
+
+	// 混合比较时整数转换成浮点数, 超出 2^53 可能丢失精度
+	lua_Number left = lhs.number;
+	lua_Number right = rhs.number;
+	if (lhs.isInteger) {
+		if (lhs.integer > MAX_EXACT_INTEGER || lhs.integer < -MAX_EXACT_INTEGER) {
+			return Result::Unknown;
+		}
+		left = static_cast<lua_Number>(lhs.integer);
+	}
+	if (rhs.isInteger) {
+		if (rhs.integer > MAX_EXACT_INTEGER || rhs.integer < -MAX_EXACT_INTEGER) {
+			return Result::Unknown;
+		}
+		right = static_cast<lua_Number>(rhs.integer);
+	}
+	return CompareOrdered(left, right, op);
+}
+
+template<typename T>
+ConditionPredicate::Result ConditionPredicate::CompareOrdered(T lhs, T rhs, CompareOp op) {
+	bool result = false;
+	switch (op) {
+		case CompareOp::Eq:
+			result = lhs == rhs;
+			break;
+		case CompareOp::Ne:
+			result = lhs != rhs;
+			break;
+		case CompareOp::Lt:
+			result = lhs < rhs;
+			break;
+		case CompareOp::Le:
+			result = lhs <= rhs;
+			break;
+		case CompareOp::Gt:
+			result = lhs > rhs;
+			break;
+		case CompareOp::Ge:
+			result = lhs >= rhs;
+			break;
+	}
+	return result ? Result::True : Result::False;
+}
@@ -16,17 +16,42 @@
 #include "emmy_debugger/debugger/emmy_debugger.h"
 #include <algorithm>
 #include <cassert>
-#include <sstream>
+#include <climits>
+#include <chrono>
 #include <cstring>
 #include "emmy_debugger/emmy_facade.h"
 #include "emmy_debugger/debugger/hook_state.h"
+#include "emmy_debugger/debugger/condition_predicate.h"
+#include "emmy_debugger/debugger/value_formatter.h"
+#include "emmy_debugger/debugger/log_template.h"
+#include "emmy_debugger/debugger/hit_condition.h"
+#include "emmy_debugger/debugger/variable_path.h"
+#include "emmy_debugger/debugger/eval_sandbox.h"
+#include "emmy_debugger/debugger/emmy_debugger_manager.h"
 #include "emmy_debugger/api/lua_version.h"
+#include "emmy_debugger/api/lua_state.h"
 #include "emmy_debugger/util.h"
 
-#define CACHE_TABLE_NAME "_emmy_cache_table_"
 #define CACHE_QUERY_NAME "_emmy_query_table_"
+// 编译后的求值chunk, 以 lua版本 + 语句文本为键
+#define EVAL_CHUNK_TABLE_NAME "_emmy_eval_chunk_table_"
+// 求值chunk 缓存的上限, 超过后整体清空
+#define EVAL_CHUNK_CACHE_LIMIT 256
+// 惰性求值环境
+#define EVAL_ENV_TABLE_NAME "_emmy_eval_env_table_"
+// 函数布局缓存的上限, 超过后整体清空
+#define FRAME_LAYOUT_CACHE_LIMIT 1024
+// 5.2 以后的源码中只有 LUA_HOOKTAILCALL, 值相同
+#ifndef LUA_HOOKTAILRET
+#define LUA_HOOKTAILRET 4
+#endif
+// 路径缓存的上限, 超过后整体清空, 防止大量动态chunk让缓存无限增长
+#define CHUNK_FILE_CACHE_LIMIT 4096
+// 路径缓存中字符串 chunk 的 source, 缓存期间引用住, 地址不会被其他 chunk 复用
+#define CHUNK_SOURCE_TABLE_NAME "_emmy_chunk_source_table_"
 
-int cacheId = 1;
+thread_local Debugger::EvalFrame *Debugger::currentEvalFrame = nullptr;
+thread_local bool Debugger::evalEnvDirty = false;
 
 void WaitConnectedHook(lua_State *L, lua_Debug *ar) {
 	// EmmyFacade::Get()
@@ -38,11 +63,28 @@ Debugger::Debugger(lua_State *L, EmmyDebuggerManager *manager)
 	  mainL(L),
 	  manager(manager),
 	  hookState(nullptr),
+	  activeHookState(nullptr),
 	  running(false),
 	  skipHook(false),
 	  blocking(false),
+	  luaThreadExecutorsEpoch(0),
+	  luaThreadExecutorsPending(false),
 	  arenaRef(nullptr),
-	  displayCustomTypeInfo(false) {
+	  stackArena(std::make_shared<VariableArena>()),
+	  scratchArena(std::make_shared<VariableArena>()),
+	  scratchEvalContext(scratchArena),
+	  displayCustomTypeInfo(false),
+	  hookStateVersion(1),
+	  hookMaskStateVersion(0),
+	  hookMaskBreakpointVersion(0),
+	  hookMask(LUA_MASKCOUNT),
+	  hookMaskL(nullptr),
+	  hookMaskChanged(false),
+	  coroutineHookMask(0),
+	  hookStateMask(0),
+	  hookLineGated(false),
+	  chunkFileFixPath(nullptr),
+	  evalChunkCount(0) {
 }
 
 Debugger::~Debugger() {
@@ -59,6 +101,8 @@ void Debugger::Attach() {
 	if (!running)
 		return;
 
+	CheckFixPath(currentL);
+
 	// execute helper code
 	if (!manager->helperCode.empty()) {
 		ExecuteOnLuaThread([this](lua_State *L) {
@@ -94,35 +138,36 @@ void Debugger::Hook(lua_Debug *ar, lua_State *L) {
 	}
 	// 设置当前协程
 	SetCurrentState(L);
+	const int event = getDebugEvent(ar);
+	if (event == LUA_HOOKCOUNT) {
+		CheckFixPath(L);
+	}
+	// 每个协程的hook 是独立的，在各自的hook 事件中更新
+	UpdateHookMask(L, ar);
+	UpdateCoroutineHooks(L);
 
-	if (getDebugEvent(ar) == LUA_HOOKLINE) {
-		// 对luaTreadExecutors 执行加锁
-		{
-			std::unique_lock<std::mutex> lock(luaThreadMtx);
-			if (!luaThreadExecutors.empty()) {
-				for (auto &executor: luaThreadExecutors) {
-					ExecuteWithSkipHook(executor);
-				}
-				luaThreadExecutors.clear();
-			}
-		}
+	// 计数hook 一直打开, 待执行的任务最多等待 HookCount 条指令
+	if ((event == LUA_HOOKLINE || event == LUA_HOOKCOUNT) &&
+		luaThreadExecutorsPending.load(std::memory_order_acquire)) {
+		ProcessLuaThreadExecutors();
+	}
+
+	if (event == LUA_HOOKLINE) {
 		auto bp = FindBreakPoint(ar);
 		if (bp && ProcessBreakPoint(bp)) {
 			HandleBreak();
 			return;
 		}
-		// 加锁
-
-		std::shared_ptr<HookState> state = nullptr;
-
-		{
-			std::lock_guard<std::mutex> lock(hookStateMtx);
-			state = hookState;
-		}
+	}
+	// 按函数开关行事件时 call/return 可能只为断点服务, 状态机不需要
+	else if (hookLineGated && !(hookStateMask & (LUA_MASKCALL | LUA_MASKRET))) {
+		return;
+	}
 
-		if (state) {
-			state->ProcessHook(shared_from_this(), currentL, ar);
-		}
+	// 单步的状态机需要 call/return 事件维护栈深度
+	const auto state = activeHookState.load(std::memory_order_acquire);
+	if (state) {
+		state->ProcessHook(this, currentL, ar);
 	}
 }
 
@@ -142,13 +187,12 @@ void Debugger::Stop() {
 	{
 		std::lock_guard<std::mutex> lock(hookStateMtx);
 		hookState = nullptr;
+		activeHookState.store(nullptr, std::memory_order_release);
+		hookStateVersion.fetch_add(1, std::memory_order_release);
 	}
 
-	{
-		// clear lua thread executors
-		std::unique_lock<std::mutex> luaThreadLock(luaThreadMtx);
-		luaThreadExecutors.clear();
-	}
+	// 队列只能在lua 线程中取出, 这里只让已入队的 executor 失效
+	luaThreadExecutorsEpoch.fetch_add(1, std::memory_order_release);
 	ExitDebugMode();
 }
 
@@ -160,13 +204,14 @@ bool Debugger::IsMainCoroutine(lua_State *L) const {
 	return L == mainL;
 }
 
-bool Debugger::GetStacks(std::vector<Stack> &stacks) {
+bool Debugger::GetStacks(std::vector<Stack> &stacks, bool lazyStacks) {
 	if (!currentL) {
 		return false;
 	}
 
 	auto prevCurrentL = currentL;
 	auto L = currentL;
+	stackArena->Clear();
 
 	int totalLevel = 0;
 	while (true) {
@@ -186,49 +231,13 @@ bool Debugger::GetStacks(std::vector<Stack> &stacks) {
 			stack.functionName = getDebugName(&ar) == nullptr ? "" : getDebugName(&ar);
 			stack.level = totalLevel++;
 			stack.line = getDebugCurrentLine(&ar);
+			stack.variableArena = stackArena;
 
-			// get variables
-			{
-				for (int i = 1;; i++) {
-					const char *name = lua_getlocal(L, &ar, i);
-					if (name == nullptr) {
-						break;
-					}
-					if (name[0] == '(') {
-						lua_pop(L, 1);
-						continue;
-					}
-
-					// add local variable
-					auto var = stack.variableArena->Alloc();
-					var->name = name;
-					SetVariableArena(stack.variableArena.get());
-					GetVariable(L, var, -1, 1);
-					ClearVariableArenaRef();
-					lua_pop(L, 1);
-					stack.localVariables.push_back(var);
-				}
-
-				if (lua_getinfo(L, "f", &ar)) {
-					const int fIdx = lua_gettop(L);
-					for (int i = 1;; i++) {
-						const char *name = lua_getupvalue(L, fIdx, i);
-						if (!name) {
-							break;
-						}
-
-						// add up variable
-						auto var = stack.variableArena->Alloc();
-						var->name = name;
-						SetVariableArena(stack.variableArena.get());
-						GetVariable(L, var, -1, 1);
-						ClearVariableArenaRef();
-						lua_pop(L, 1);
-						stack.upvalueVariables.push_back(var);
-					}
-					// pop function
-					lua_pop(L, 1);
-				}
+			// 其他栈帧的变量在 IDE 打开时再读取
+			if (lazyStacks && stack.level > 0) {
+				stack.hasVariables = false;
+			} else {
+				GetStackVariables(L, &ar, stack);
 			}
 
 			level++;
@@ -249,6 +258,49 @@ bool Debugger::GetStacks(std::vector<Stack> &stacks) {
 	return false;
 }
 
+void Debugger::GetStackVariables(lua_State *L, lua_Debug *ar, Stack &stack) {
+	for (int i = 1;; i++) {
+		const char *name = lua_getlocal(L, ar, i);
+		if (name == nullptr) {
+			break;
+		}
+		if (name[0] == '(') {
+			lua_pop(L, 1);
+			continue;
+		}
+
+		// add local variable
+		auto var = stack.variableArena->Alloc();
+		var.SetName(name);
+		SetVariableArena(stack.variableArena.get());
+		GetVariable(L, var, -1, 1);
+		ClearVariableArenaRef();
+		lua_pop(L, 1);
+		stack.localVariables.push_back(var);
+	}
+
+	if (lua_getinfo(L, "f", ar)) {
+		const int fIdx = lua_gettop(L);
+		for (int i = 1;; i++) {
+			const char *name = lua_getupvalue(L, fIdx, i);
+			if (!name) {
+				break;
+			}
+
+			// add up variable
+			auto var = stack.variableArena->Alloc();
+			var.SetName(name);
+			SetVariableArena(stack.variableArena.get());
+			GetVariable(L, var, -1, 1);
+			ClearVariableArenaRef();
+			lua_pop(L, 1);
+			stack.upvalueVariables.push_back(var);
+		}
+		// pop function
+		lua_pop(L, 1);
+	}
+}
+
 bool CallMetaFunction(lua_State *L, int valueIndex, const char *method, int numResults, int &result) {
 	if (lua_getmetatable(L, valueIndex)) {
 		const int metaIndex = lua_gettop(L);
@@ -270,15 +322,22 @@ bool CallMetaFunction(lua_State *L, int valueIndex, const char *method, int numR
 	return false;
 }
 
-std::string ToPointer(lua_State *L, int index) {
-	const void *pointer = lua_topointer(L, index);
-	std::stringstream ss;
-	ss << lua_typename(L, lua_type(L, index)) << "(0x" << std::hex << pointer << ")";
-	return ss.str();
+// typename(0x...)
+ValueFormatter &FormatPointer(ValueFormatter &formatter, lua_State *L, int index) {
+	return formatter.Append(lua_typename(L, lua_type(L, index)))
+		.Append("(", 1)
+		.AppendPointer(lua_topointer(L, index))
+		.Append(")", 1);
+}
+
+void SetPointerValue(Variable variable, lua_State *L, int index) {
+	ValueFormatter formatter;
+	FormatPointer(formatter, L, index);
+	variable.SetValue(formatter.Data(), formatter.Size());
 }
 
 #ifndef EMMY_USE_LUA_SOURCE
-void DisplayFunction54(Idx<Variable> variable, lua_State *L, int index, lua_Debug_54 &ar) {
+void DisplayFunction54(Variable variable, lua_State *L, int index, lua_Debug_54 &ar) {
 	if (ar.what == nullptr) {
 		return;
 	}
@@ -298,15 +357,15 @@ void DisplayFunction54(Idx<Variable> variable, lua_State *L, int index, lua_Debu
 			}
 		}
 		showValue.push_back(')');
-		variable->value = showValue;
-		variable->valueType = 9;
-		variable->valueTypeName = "function";
+		variable.SetValue(showValue);
+		variable.SetValueType(9);
+		variable.SetValueTypeName("function");
 		// ptr
 		auto ptr = variable.GetArena()->Alloc();
-		ptr->nameType = LUA_TSTRING;
-		ptr->valueType = LUA_TFUNCTION;
-		ptr->name = "pointer";
-		ptr->value = ToPointer(L, index);
+		ptr.SetNameType(LUA_TSTRING);
+		ptr.SetValueType(LUA_TFUNCTION);
+		ptr.SetName("pointer");
+		SetPointerValue(ptr, L, index);
 
 		// source
 		if (ar.source) {
@@ -315,24 +374,26 @@ void DisplayFunction54(Idx<Variable> variable, lua_State *L, int index, lua_Debu
 				sourceText = sourceText.substr(1);
 			}
 			auto source = variable.GetArena()->Alloc();
-			source->nameType = LUA_TSTRING;
-			source->valueType = LUA_TSTRING;
-			source->name = "source";
-			source->value = sourceText.append(":").append(std::to_string(ar.linedefined));
+			source.SetNameType(LUA_TSTRING);
+			source.SetValueType(LUA_TSTRING);
+			source.SetName("source");
+			source.SetValue(sourceText.append(":").append(std::to_string(ar.linedefined)));
 		}
 	} else if (what == "C") {
-		variable->value = "C " + ToPointer(L, index);
+		ValueFormatter formatter;
+		FormatPointer(formatter.Append("C ", 2), L, index);
+		variable.SetValue(formatter.Data(), formatter.Size());
 	} else {
-		variable->value = ToPointer(L, index);
+		SetPointerValue(variable, L, index);
 		return;
 	}
 }
 
-void DisplayFunction(Idx<Variable> variable, lua_State *L, int index) {
+void DisplayFunction(Variable variable, lua_State *L, int index) {
 	lua_Debug ar{};
 	lua_pushvalue(L, index);
 	if (lua_getinfo(L, ">Snu", &ar) == 0) {
-		variable->value = ToPointer(L, index);
+		SetPointerValue(variable, L, index);
 	}
 	else {
 		switch (luaVersion) {
@@ -341,7 +402,7 @@ void DisplayFunction(Idx<Variable> variable, lua_State *L, int index) {
 				break;
 			}
 			default: {
-				variable->value = ToPointer(L, index);
+				SetPointerValue(variable, L, index);
 				break;
 			}
 		}
@@ -349,8 +410,36 @@ void DisplayFunction(Idx<Variable> variable, lua_State *L, int index) {
 	lua_settop(L, index);
 }
 #endif
+// 用表的键设置子节点的名字
+void SetKeyName(lua_State *L, int keyIndex, Variable variable) {
+	const auto t = lua_type(L, keyIndex);
+	variable.SetNameType(t);
+	switch (t) {
+		case LUA_TSTRING: {
+			variable.SetName(lua_tostring(L, keyIndex));
+			break;
+		}
+		case LUA_TNUMBER: {
+			ValueFormatter formatter;
+			formatter.AppendNumber(lua_tonumber(L, keyIndex));
+			variable.SetName(formatter.Data(), formatter.Size());
+			break;
+		}
+		case LUA_TBOOLEAN: {
+			variable.SetName(lua_toboolean(L, keyIndex) ? "true" : "false");
+			break;
+		}
+		default: {
+			ValueFormatter formatter;
+			FormatPointer(formatter, L, keyIndex);
+			variable.SetName(formatter.Data(), formatter.Size());
+			break;
+		}
+	}
+}
+
 // algorithm optimization
-void Debugger::GetVariable(lua_State *L, Idx<Variable> variable, int index, int depth, bool queryHelper) {
+void Debugger::GetVariable(lua_State *L, Variable variable, int index, int depth, bool queryHelper) {
 	if (!L) {
 		L = currentL;
 	}
@@ -366,11 +455,11 @@ void Debugger::GetVariable(lua_State *L, Idx<Variable> variable, int index, int
 
 	const int topIndex = lua_gettop(L);
 	index = lua_absindex(L, index);
-	CacheValue(index, variable);
+	CacheValue(L, index, variable);
 	const int type = lua_type(L, index);
 	const char *typeName = lua_typename(L, type);
-	variable->valueTypeName = typeName;
-	variable->valueType = type;
+	variable.SetValueTypeName(typeName);
+	variable.SetValueType(type);
 
 	if (queryHelper) {
 		if (displayCustomTypeInfo && type >= 0 && type < registeredTypes.size() && registeredTypes.test(type)
@@ -384,20 +473,20 @@ void Debugger::GetVariable(lua_State *L, Idx<Variable> variable, int index, int
 	}
 	switch (type) {
 		case LUA_TNIL: {
-			variable->value = "nil";
+			variable.SetValue("nil");
 			break;
 		}
 		case LUA_TNUMBER: {
-			variable->value = lua_tostring(L, index);
+			variable.SetValue(lua_tostring(L, index));
 			break;
 		}
 		case LUA_TBOOLEAN: {
 			const bool v = lua_toboolean(L, index);
-			variable->value = v ? "true" : "false";
+			variable.SetValue(v ? "true" : "false");
 			break;
 		}
 		case LUA_TSTRING: {
-			variable->value = lua_tostring(L, index);
+			variable.SetValue(lua_tostring(L, index));
 			break;
 		}
 		case LUA_TUSERDATA: {
@@ -410,9 +499,9 @@ void Debugger::GetVariable(lua_State *L, Idx<Variable> variable, int index, int
 				}
 			}
 			if (string) {
-				variable->value = string;
+				variable.SetValue(string);
 			} else {
-				variable->value = ToPointer(L, index);
+				SetPointerValue(variable, L, index);
 			}
 			if (depth > 1) {
 				if (lua_getmetatable(L, index)) {
@@ -426,70 +515,65 @@ void Debugger::GetVariable(lua_State *L, Idx<Variable> variable, int index, int
 #ifndef EMMY_USE_LUA_SOURCE
 			DisplayFunction(variable, L, index);
 #else
-			variable->value = ToPointer(L, index);
+			SetPointerValue(variable, L, index);
 #endif
 
 			break;
 		}
 		case LUA_TLIGHTUSERDATA:
 		case LUA_TTHREAD: {
-			variable->value = ToPointer(L, index);
+			SetPointerValue(variable, L, index);
 			break;
 		}
 		case LUA_TTABLE: {
 			std::size_t tableSize = 0;
 			const void *tableAddr = lua_topointer(L, index);
-			lua_pushnil(L);
-			while (lua_next(L, index)) {
-				// k: -2, v: -1
-				if (depth > 1) {
-					//todo: use allocator
-					auto v = variable.GetArena()->Alloc();
-					const auto t = lua_type(L, -2);
-					v->nameType = t;
-                    switch (t) {
-                        case LUA_TSTRING:
-                        {
-                            v->name = lua_tostring(L, -2);
-                            break;
-                        }
-                        case LUA_TNUMBER:
-                        {
-                            auto number = lua_tonumber(L, -2);
-                            if (static_cast<long long>(number) == number) {
-                                v->name = std::to_string(static_cast<long long>(number));
-                            } else {
-                                v->name = std::to_string(number);
-                            }
-                            break;
-                        }
-                        case LUA_TBOOLEAN:
-                        {
-                            v->name = lua_toboolean(L, -2) ? "true" : "false";
-                            break;
-                        }
-                        default: {
-                            v->name = ToPointer(L, -2);
-                            break;
-                        }
-                    }
-
-					GetVariable(L, v, -1, depth - 1);
-					variable->children.push_back(v);
+			// 从表的内部布局读取大小, 不需要子节点时不遍历表
+			TableShape shape;
+			lua_pushvalue(L, index);
+			const bool hasShape = GetTableShape(L, shape);
+			lua_pop(L, 1);
+			bool sizeEstimated = false;
+			if (hasShape && depth <= 1) {
+				tableSize = shape.arrayUsed + shape.hashUsed;
+				sizeEstimated = shape.estimated;
+			} else {
+				lua_pushnil(L);
+				const int childrenLimit = manager->tableChildrenLimit;
+				while (lua_next(L, index)) {
+					// k: -2, v: -1
+					if (depth > 1) {
+						if (childrenLimit > 0 && tableSize >= static_cast<std::size_t>(childrenLimit)) {
+							// 其余的子节点由 ExpandVariableReq 分页读取
+							variable.SetTruncated(true);
+							if (hasShape) {
+								lua_pop(L, 2);
+								tableSize = (std::max)(tableSize, shape.arrayUsed + shape.hashUsed);
+								sizeEstimated = shape.estimated;
+								break;
+							}
+						} else {
+							//todo: use allocator
+							auto v = variable.GetArena()->Alloc();
+							SetKeyName(L, -2, v);
+							GetVariable(L, v, -1, depth - 1);
+							variable.AddChild(v);
+						}
+					}
+					lua_pop(L, 1);
+					tableSize++;
 				}
-				lua_pop(L, 1);
-				tableSize++;
 			}
 
 
 			if (lua_getmetatable(L, index)) {
 				// metatable
 				auto metatable = variable.GetArena()->Alloc();
-				metatable->name = "(metatable)";
-				metatable->nameType = lua_type(L, -1);
+				metatable.SetName("(metatable)");
+				metatable.SetNameType(lua_type(L, -1));
 
 				GetVariable(L, metatable, -1, depth - 1);
-				variable->children.push_back(metatable);
+				variable.AddChild(metatable);
 
 				//__index
 				if (lua_istable(L, -1)) {
@@ -498,10 +582,10 @@ void Debugger::GetVariable(lua_State *L, Idx<Variable> variable, int index, int
 					lua_rawget(L, -2);
 					if (!lua_isnil(L, -1)) {
 						auto v = variable.GetArena()->Alloc();
-						v->name = "(metatable.__index)";
-						v->nameType = lua_type(L, -1);
+						v.SetName("(metatable.__index)");
+						v.SetNameType(lua_type(L, -1));
 						GetVariable(L, v, -1, depth - 1);
-						variable->children.push_back(v);
+						variable.AddChild(v);
 					}
 					lua_pop(L, 1);
 				}
@@ -510,9 +594,13 @@ void Debugger::GetVariable(lua_State *L, Idx<Variable> variable, int index, int
 				lua_pop(L, 1);
 			}
 
-			std::stringstream ss;
-			ss << "table(0x" << std::hex << tableAddr << std::dec << ", size = " << tableSize << ")";
-			variable->value = ss.str();
+			ValueFormatter formatter;
+			formatter.Append("table(", 6)
+				.AppendPointer(tableAddr)
+				.Append(sizeEstimated ? ", size ~ " : ", size = ")
+				.AppendUnsigned(tableSize)
+				.Append(")", 1);
+			variable.SetValue(formatter.Data(), formatter.Size());
 			break;
 		}
 	}
@@ -520,50 +608,19 @@ void Debugger::GetVariable(lua_State *L, Idx<Variable> variable, int index, int
 	assert(t2 == topIndex);
 }
 
-void Debugger::CacheValue(int valueIndex, Idx<Variable> variable) const {
-	if (!currentL) {
-		return;
-	}
-
-	auto L = currentL;
-
+void Debugger::CacheValue(lua_State *L, int valueIndex, Variable variable) {
 	const int type = lua_type(L, valueIndex);
 	if (type == LUA_TUSERDATA || type == LUA_TTABLE) {
-		const int id = cacheId++;
-		variable->cacheId = id;
-		const int top = lua_gettop(L);
-		lua_getfield(L, LUA_REGISTRYINDEX, CACHE_TABLE_NAME);// 1: cacheTable|nil
-		if (lua_isnil(L, -1)) {
-			lua_pop(L, 1);                                       //
-			lua_newtable(L);                                     // 1: {}
-			lua_setfield(L, LUA_REGISTRYINDEX, CACHE_TABLE_NAME);//
-			lua_getfield(L, LUA_REGISTRYINDEX, CACHE_TABLE_NAME);// 1: cacheTable
-		}
-
-		lua_pushvalue(L, valueIndex);// 1: cacheTable, 2: value
-
-		// snprintf 性能不够，问题也很大，这里采用c++标准算法
-		std::string key = std::to_string(id);
-		lua_setfield(L, -2, key.c_str());// 1: cacheTable
-
-		lua_settop(L, top);
+		variable.SetCacheId(variableCache.Store(L, valueIndex, manager->weakCache));
 	}
 }
 
-void Debugger::ClearCache() const {
+void Debugger::ClearCache() {
 	if (!currentL) {
 		return;
 	}
 
-	auto L = currentL;
-
-
-	lua_getfield(L, LUA_REGISTRYINDEX, CACHE_TABLE_NAME);
-	if (!lua_isnil(L, -1)) {
-		lua_pushnil(L);
-		lua_setfield(L, LUA_REGISTRYINDEX, CACHE_TABLE_NAME);
-	}
-	lua_pop(L, 1);
+	variableCache.Clear(currentL);
 }
 
 void Debugger::DoAction(DebugAction action) {
@@ -597,7 +654,99 @@ void Debugger::UpdateHook(int mask, lua_State *L) {
 	if (mask == 0)
 		lua_sethook(L, nullptr, mask, 0);
 	else
-		lua_sethook(L, EmmyFacade::HookLua, mask, 0);
+		lua_sethook(L, EmmyFacade::HookLua, mask, (mask & LUA_MASKCOUNT) ? HookCount : 0);
+}
+
+int Debugger::GetHookMask(lua_State *L) {
+	const auto stateVersion = hookStateVersion.load(std::memory_order_acquire);
+	const auto index = manager->AcquireBreakpointIndex();
+	const bool versionChanged = stateVersion != hookMaskStateVersion || index->GetVersion() != hookMaskBreakpointVersion;
+	if (L == hookMaskL && !versionChanged) {
+		return hookMask;
+	}
+	if (versionChanged) {
+		hookMaskChanged = true;
+	}
+
+	// 计数hook 一直保留，保证每个协程都有机会重新计算mask
+	int stateMask = 0;
+	const auto state = activeHookState.load(std::memory_order_acquire);
+	if (state) {
+		stateMask = state->GetHookMask(L);
+	}
+	int mask = LUA_MASKCOUNT | stateMask;
+
+	// 仅断点需要行事件时，通过 call/ret 在进出函数时决定是否打开
+	hookLineGated = !(mask & LUA_MASKLINE) && !index->Empty();
+	if (hookLineGated) {
+		mask |= LUA_MASKCALL | LUA_MASKRET;
+	}
+
+	hookMask = mask;
+	hookMaskL = L;
+	hookStateMask = stateMask;
+	hookMaskStateVersion = stateVersion;
+	hookMaskBreakpointVersion = index->GetVersion();
+	return mask;
+}
+
+void Debugger::InvalidateHookMask() {
+	hookStateVersion.fetch_add(1, std::memory_order_release);
+}
+
+void Debugger::UpdateCoroutineHooks(lua_State *L) {
+	if (!hookMaskChanged) {
+		return;
+	}
+	hookMaskChanged = false;
+	// 只有mask 增加时其他协程才会缺少需要的事件
+	// mask 减少时多余的事件无害, 各协程在下一次计数hook 时自行更新
+	const int mask = GetHookMask(nullptr);
+	const bool grown = (mask & ~coroutineHookMask) != 0;
+	coroutineHookMask = mask;
+	if (!grown) {
+		return;
+	}
+	// luajit 的hook 是全局的, 已经随 L 更新
+	if (luaVersion == LuaVersion::LUA_JIT) {
+		return;
+	}
+
+	auto states = FindAllCoroutine(L);
+	if (mainL) {
+		states.push_back(mainL);
+	}
+	for (auto state: states) {
+		if (state != L) {
+			UpdateHookMask(state);
+		}
+	}
+}
+
+void Debugger::UpdateHookMask(lua_State *L, lua_Debug *ar) {
+	int mask = GetHookMask(L);
+	const int currentMask = lua_gethookmask(L);
+	if (hookLineGated) {
+		const int event = ar ? getDebugEvent(ar) : LUA_HOOKCOUNT;
+		// 行事件说明当前函数已经打开了行hook
+		if (event == LUA_HOOKLINE && (currentMask | LUA_MASKLINE) == (mask | LUA_MASKLINE)) {
+			return;
+		}
+
+		// 返回时即将回到调用者, 5.1 的 tail return 同理
+		bool isReturn = event == LUA_HOOKRET;
+		if (event == LUA_HOOKTAILRET) {
+			isReturn = luaVersion == LuaVersion::LUA_51 || luaVersion == LuaVersion::LUA_JIT;
+		}
+
+		if (ActivationHasBreakPoint(L, isReturn ? 1 : 0)) {
+			mask |= LUA_MASKLINE;
+		}
+	}
+
+	if (currentMask != mask) {
+		UpdateHook(mask, L);
+	}
 }
 
 
@@ -621,34 +770,132 @@ std::string Debugger::GetFile(lua_Debug *ar) const {
 		return "";
 	}
 
+	const char *source = getDebugSource(ar);
+	if (getDebugCurrentLine(ar) < 0)
+		return source;
+
+	return GetChunkFile(ar).file;
+}
+
+Debugger::ChunkFile &Debugger::GetChunkFile(lua_Debug *ar) const {
 	auto L = currentL;
 
-	const char *file = getDebugSource(ar);
-	if (getDebugCurrentLine(ar) < 0)
-		return file;
+	const char *source = getDebugSource(ar);
+
+	auto it = chunkFileCache.find(source);
+	if (it != chunkFileCache.end() && IsSameSource(it->second, source)) {
+		return it->second;
+	}
+
+	const char *file = source;
 	if (strlen(file) > 0 && file[0] == '@')
 		file++;
+
+	std::string resolved = file;
+	const int top = lua_gettop(L);
 	lua_pushcclosure(L, FixPath, 0);
 	lua_pushstring(L, file);
 	const int result = lua_pcall(L, 1, 1, 0);
-	if (result == LUA_OK) {
-		const auto p = lua_tostring(L, -1);
+	if (result != LUA_OK) {
+		// fixPath 出错时不缓存, 下次再试
+		lua_settop(L, top);
+		uncachedChunkFile = ChunkFile();
+		uncachedChunkFile.source = source;
+		uncachedChunkFile.file = resolved;
+		return uncachedChunkFile;
+	}
+	const auto p = lua_tostring(L, -1);
+	if (p) {
+		resolved = p;
+	}
+	lua_settop(L, top);
+
+	if (chunkFileCache.size() >= CHUNK_FILE_CACHE_LIMIT) {
+		ClearChunkFileCache(L);
+	}
+	auto &entry = chunkFileCache[source];
+	entry = ChunkFile();
+	// load 的字符串 chunk 的 source 是整段代码, 引用住之后不用复制也不用比较
+	if (source[0] != '@' && source[0] != '=' && PinChunkSource(L, source)) {
+		entry.pinned = true;
+	} else {
+		entry.source = source;
+	}
+	entry.file = resolved;
+	return entry;
+}
+
+bool Debugger::IsSameSource(const ChunkFile &chunk, const char *source) {
+	// 引用住的字符串不会被回收, 地址相同就是同一个 chunk
+	if (chunk.pinned) {
+		return true;
+	}
+	// 文件名很短, luajit 的字符串 chunk 无法引用, 完整比较
+	return chunk.source == source;
+}
+
+bool Debugger::PinChunkSource(lua_State *L, const char *source) {
+	const int top = lua_gettop(L);
+	lua_getfield(L, LUA_REGISTRYINDEX, CHUNK_SOURCE_TABLE_NAME);
+	if (lua_type(L, -1) != LUA_TTABLE) {
 		lua_pop(L, 1);
-		if (p) {
-			return p;
+		lua_newtable(L);
+		lua_pushvalue(L, -1);
+		lua_setfield(L, LUA_REGISTRYINDEX, CHUNK_SOURCE_TABLE_NAME);
+	}
+	if (!PushSourceString(L, source)) {
+		lua_settop(L, top);
+		return false;
+	}
+	lua_pushboolean(L, 1);
+	lua_rawset(L, -3);
+	lua_settop(L, top);
+	return true;
+}
+
+void Debugger::ClearChunkFileCache(lua_State *L) const {
+	chunkFileCache.clear();
+	lua_pushnil(L);
+	lua_setfield(L, LUA_REGISTRYINDEX, CHUNK_SOURCE_TABLE_NAME);
+}
+
+void Debugger::CheckFixPath(lua_State *L) const {
+	// fixPath 被替换后之前的解析结果都不再可信
+	const void *fixPath = GetFixPathIdentity(L);
+	if (fixPath != chunkFileFixPath) {
+		ClearChunkFileCache(L);
+		chunkFileFixPath = fixPath;
+	}
+}
+
+const void *Debugger::GetFixPathIdentity(lua_State *L) const {
+	// 只做 raw 访问, 不触发元方法, hook 中不会因此重入lua
+	const void *identity = nullptr;
+	const int top = lua_gettop(L);
+	lua_pushglobaltable(L);
+	lua_pushstring(L, "emmy");
+	lua_rawget(L, -2);
+	if (lua_istable(L, -1)) {
+		lua_pushstring(L, "fixPath");
+		lua_rawget(L, -2);
+		if (lua_isfunction(L, -1)) {
+			identity = lua_topointer(L, -1);
 		}
 	}
-	// todo: handle error
-	return file;
+	lua_settop(L, top);
+	return identity;
 }
 
 void Debugger::HandleBreak() {
-	// to be on the safe side, hook it again
-	UpdateHook(LUA_MASKCALL | LUA_MASKLINE | LUA_MASKRET, currentL);
+	CheckFixPath(currentL);
 
 	if (EmmyFacade::Get().OnBreak(shared_from_this())) {
 		EnterDebugMode();
 	}
+
+	// 恢复执行前按新的状态更新hook，单步需要的事件不能等到下一次计数hook
+	UpdateHookMask(currentL);
+	UpdateCoroutineHooks(currentL);
 }
 
 // host thread
@@ -664,14 +911,41 @@ void Debugger::EnterDebugMode() {
 			lockEval.lock();
 		}
 		if (!evalQueue.empty()) {
-			const auto evalContext = evalQueue.front();
+			const auto request = evalQueue.front();
 			evalQueue.pop();
 			lockEval.unlock();
 			const bool skip = skipHook;
 			skipHook = true;
-			evalContext->success = DoEval(evalContext);
+			if (request.batch) {
+				DoBatchEval(request.batch);
+			} else if (request.stack) {
+				DoStackVariables(request.stack);
+			} else if (request.expand) {
+				DoExpandVariable(request.expand);
+			} else {
+				request.eval->success = DoEval(request.eval);
+			}
 			skipHook = skip;
-			EmmyFacade::Get().OnEvalResult(evalContext);
+			if (request.batch) {
+				EmmyFacade::Get().OnBatchEvalResult(request.batch);
+			} else if (request.stack) {
+				EmmyFacade::Get().OnStackVariablesResult(request.stack);
+			} else if (request.expand) {
+				const auto expand = request.expand;
+				// 只读取了跳过的部分时不发送
+				if (expand->done || !expand->children.empty()) {
+					EmmyFacade::Get().OnExpandVariableResult(expand);
+				}
+				expand->ClearChunk();
+				// 剩下的放回队尾, 先处理这期间收到的其他请求, 恢复运行后不再继续
+				lockEval.lock();
+				if (!expand->done && blocking) {
+					evalQueue.push(request);
+				}
+				lockEval.unlock();
+			} else {
+				EmmyFacade::Get().OnEvalResult(request.eval);
+			}
 			continue;
 		}
 		break;
@@ -787,22 +1061,233 @@ bool Debugger::CreateEnv(lua_State *L, int stackLevel) {
 	return true;
 }
 
+const Debugger::FrameLayout *Debugger::GetFrameLayout(lua_State *L, lua_Debug *ar) {
+	if (!lua_getinfo(L, "f", ar)) {
+		return nullptr;
+	}
+	auto &info = functionDebugInfo;
+	if (!GetFunctionDebugInfo(L, info, false)) {
+		lua_pop(L, 1);
+		return nullptr;
+	}
+	auto it = frameLayoutCache.find(info.proto);
+	if (it != frameLayoutCache.end() && it->second.code == info.code && it->second.lineDefined == info.lineDefined) {
+		lua_pop(L, 1);
+		return &it->second;
+	}
+
+	GetFunctionDebugInfo(L, info, true);
+	lua_pop(L, 1);
+	if (frameLayoutCache.size() >= FRAME_LAYOUT_CACHE_LIMIT) {
+		frameLayoutCache.clear();
+	}
+	auto &layout = frameLayoutCache[info.proto];
+	layout.code = info.code;
+	layout.lineDefined = info.lineDefined;
+	layout.locals.clear();
+	layout.upvalues.clear();
+
+	// 局部变量在作用域内占用固定的寄存器, 等于声明时仍然活跃的外层局部变量数
+	// lua_getlocal 的第 n 个活跃局部变量就在第 n-1 个寄存器上
+	const auto &locVars = info.locVars;
+	for (std::size_t i = 0; i < locVars.size(); i++) {
+		if (locVars[i].name[0] == '(') {
+			continue;
+		}
+		int reg = 0;
+		for (std::size_t j = 0; j < i; j++) {
+			if (locVars[j].startpc <= locVars[i].startpc && locVars[i].startpc < locVars[j].endpc) {
+				reg++;
+			}
+		}
+		auto &slots = layout.locals[locVars[i].name];
+		if (std::find(slots.begin(), slots.end(), reg + 1) == slots.end()) {
+			slots.push_back(reg + 1);
+		}
+	}
+	for (auto &it: layout.locals) {
+		std::sort(it.second.begin(), it.second.end(), std::greater<int>());
+	}
+	for (std::size_t i = 0; i < info.upvalues.size(); i++) {
+		if (info.upvalues[i][0] != '\0') {
+			layout.upvalues[info.upvalues[i]] = static_cast<int>(i) + 1;
+		}
+	}
+	return &layout;
+}
+
+bool Debugger::PushFrameLocal(lua_State *L, EvalFrame *frame, const char *name, int &n) {
+	auto it = frame->layout->locals.find(name);
+	if (it == frame->layout->locals.end()) {
+		return false;
+	}
+	auto FL = frame->L;
+	// 同一个寄存器在不同位置可能是别的变量, 以 lua_getlocal 返回的名字为准
+	for (int slot: it->second) {
+		const char *localName = lua_getlocal(FL, &frame->ar, slot);
+		if (localName == nullptr) {
+			continue;
+		}
+		if (strcmp(localName, name) == 0) {
+			lua_xmove(FL, L, 1);
+			n = slot;
+			return true;
+		}
+		lua_pop(FL, 1);
+	}
+	return false;
+}
+
+bool Debugger::PushFrameUpvalue(lua_State *L, EvalFrame *frame, const char *name, int &n) {
+	auto FL = frame->L;
+	auto it = frame->layout->upvalues.find(name);
+	if (it == frame->layout->upvalues.end() || !lua_getinfo(FL, "f", &frame->ar)) {
+		return false;
+	}
+	if (lua_getupvalue(FL, -1, it->second) == nullptr) {
+		lua_pop(FL, 1);
+		return false;
+	}
+	lua_remove(FL, -2);
+	lua_xmove(FL, L, 1);
+	n = it->second;
+	return true;
+}
+
+// 查找顺序与 EnvIndexFunction 相同: 上值, 局部变量, _ENV, 全局
+// 求值运行在沙箱协程中, 栈帧的变量在 frame->L 上读取后移到 L
+int Debugger::EvalEnvIndex(lua_State *L) {
+	auto frame = currentEvalFrame;
+	if (frame && lua_type(L, 2) == LUA_TSTRING) {
+		const char *name = lua_tostring(L, 2);
+		int n = 0;
+		// up value
+		if (PushFrameUpvalue(L, frame, name, n)) {
+			if (lua_isnil(L, -1) == 0) {
+				return 1;
+			}
+			lua_pop(L, 1);
+		}
+		// local value
+		if (PushFrameLocal(L, frame, name, n)) {
+			if (lua_isnil(L, -1) == 0) {
+				return 1;
+			}
+			lua_pop(L, 1);
+		}
+		// _ENV
+		if (PushFrameUpvalue(L, frame, "_ENV", n)) {
+			if (lua_istable(L, -1)) {
+				lua_getfield(L, -1, name);// _ENV[name]
+				if (lua_isnil(L, -1) == 0) {
+					return 1;
+				}
+				lua_pop(L, 1);
+			}
+			lua_pop(L, 1);
+		}
+	}
+	if (lua_type(L, 2) != LUA_TSTRING) {
+		return 0;
+	}
+	// global
+	lua_getglobal(L, lua_tostring(L, 2));
+	return 1;
+}
+
+// 局部变量和上值直接写回栈帧, 其他名字只留在环境中
+int Debugger::EvalEnvNewIndex(lua_State *L) {
+	auto frame = currentEvalFrame;
+	if (frame && lua_type(L, 2) == LUA_TSTRING) {
+		auto FL = frame->L;
+		const char *name = lua_tostring(L, 2);
+		int n = 0;
+		if (PushFrameLocal(L, frame, name, n)) {
+			lua_pop(L, 1);
+			lua_pushvalue(L, 3);
+			lua_xmove(L, FL, 1);
+			lua_setlocal(FL, &frame->ar, n);
+			return 0;
+		}
+		if (PushFrameUpvalue(L, frame, name, n)) {
+			lua_pop(L, 1);
+			if (lua_getinfo(FL, "f", &frame->ar)) {
+				lua_pushvalue(L, 3);
+				lua_xmove(L, FL, 1);
+				if (lua_setupvalue(FL, -2, n) == nullptr) {
+					lua_pop(FL, 1);
+				}
+				lua_pop(FL, 1);
+			}
+			return 0;
+		}
+	}
+	lua_settop(L, 3);
+	lua_rawset(L, 1);
+	evalEnvDirty = true;
+	return 0;
+}
+
+bool Debugger::PushLazyEnv(lua_State *L, int stackLevel, EvalFrame &frame) {
+	if (!lua_getstack(L, stackLevel, &frame.ar)) {
+		return false;
+	}
+	frame.layout = GetFrameLayout(L, &frame.ar);
+	if (!frame.layout) {
+		return false;
+	}
+	frame.L = L;
+
+	if (evalEnvDirty) {
+		lua_pushnil(L);
+		lua_setfield(L, LUA_REGISTRYINDEX, EVAL_ENV_TABLE_NAME);
+		evalEnvDirty = false;
+	}
+	lua_getfield(L, LUA_REGISTRYINDEX, EVAL_ENV_TABLE_NAME);// env|nil
+	if (lua_istable(L, -1)) {
+		return true;
+	}
+	lua_pop(L, 1);
+
+	lua_newtable(L);
+	const int env = lua_gettop(L);
+	lua_newtable(L);
+	lua_pushcclosure(L, EvalEnvIndex, 0);
+	lua_setfield(L, -2, "__index");
+	lua_pushcclosure(L, EvalEnvNewIndex, 0);
+	lua_setfield(L, -2, "__newindex");
+	lua_setmetatable(L, env);
+	lua_pushvalue(L, env);
+	lua_setfield(L, LUA_REGISTRYINDEX, EVAL_ENV_TABLE_NAME);
+	return true;
+}
+
 bool Debugger::ProcessBreakPoint(std::shared_ptr<BreakPoint> bp) {
+	const uint64_t hitCount = bp->hitCount.fetch_add(1, std::memory_order_relaxed) + 1;
 	if (!bp->condition.empty()) {
-		auto ctx = std::make_shared<EvalContext>();
-		ctx->expr = bp->condition;
-		ctx->depth = 1;
-		bool suc = DoEval(ctx);
-		return suc && ctx->result->valueType == LUA_TBOOLEAN && ctx->result->value == "true";
+		if (bp->conditionPredicate) {
+			const auto result = bp->conditionPredicate->Evaluate(currentL, 0);
+			if (result != ConditionPredicate::Result::Unknown) {
+				return result == ConditionPredicate::Result::True;
+			}
+		}
+		scratchArena->Clear();
+		scratchEvalContext.Reset();
+		scratchEvalContext.depth = 1;
+		bool suc = DoEval(scratchEvalContext, bp->condition);
+		return suc && scratchEvalContext.result.GetValueType() == LUA_TBOOLEAN
+			&& strcmp(scratchEvalContext.result.GetValue(), "true") == 0;
 	}
 	if (!bp->logMessage.empty()) {
 		DoLogMessage(bp);
 		return false;
 	}
 	if (!bp->hitCondition.empty()) {
-		bp->hitCount++;
-
-		return DoHitCondition(bp);
+		auto hitCondition = bp->hitConditionPredicate;
+		if (!hitCondition) {
+			hitCondition = std::make_shared<HitCondition>(bp->hitCondition);
+		}
+		return hitCondition->Check(hitCount);
 	}
 	return true;
 }
@@ -815,20 +1300,23 @@ void Debugger::SetHookState(std::shared_ptr<HookState> newState) {
 	auto L = currentL;
 
 	hookState = nullptr;
+	activeHookState.store(nullptr, std::memory_order_release);
 	if (newState->Start(shared_from_this(), L)) {
 		hookState = newState;
+		activeHookState.store(newState.get(), std::memory_order_release);
 	}
+	hookStateVersion.fetch_add(1, std::memory_order_release);
 }
 
 EmmyDebuggerManager *Debugger::GetEmmyDebuggerManager() {
 	return manager;
 }
 
-void Debugger::SetVariableArena(Arena<Variable> *arena) {
+void Debugger::SetVariableArena(VariableArena *arena) {
 	arenaRef = arena;
 }
 
-Arena<Variable> * Debugger::GetVariableArena() {
+VariableArena * Debugger::GetVariableArena() {
 	return arenaRef;
 }
 
@@ -893,14 +1381,68 @@ bool Debugger::Eval(std::shared_ptr<EvalContext> evalContext, bool force) {
 	// 加锁
 	{
 		std::unique_lock<std::mutex> lock(evalMtx);
-		evalQueue.push(evalContext);
+		EvalRequest request;
+		request.eval = evalContext;
+		evalQueue.push(request);
 	}
 
 	cvRun.notify_all();
 	return true;
 }
 
-int LastLevel(lua_State *L) {
+// message thread
+bool Debugger::BatchEval(std::shared_ptr<BatchEvalContext> batchContext, bool force) {
+	if (force) {
+		DoBatchEval(batchContext);
+		return true;
+	}
+	if (!blocking) {
+		return false;
+	}
+	{
+		std::unique_lock<std::mutex> lock(evalMtx);
+		EvalRequest request;
+		request.batch = batchContext;
+		evalQueue.push(request);
+	}
+
+	cvRun.notify_all();
+	return true;
+}
+
+// message thread
+bool Debugger::StackVariables(std::shared_ptr<StackVariablesContext> stackContext) {
+	if (!blocking) {
+		return false;
+	}
+	{
+		std::unique_lock<std::mutex> lock(evalMtx);
+		EvalRequest request;
+		request.stack = stackContext;
+		evalQueue.push(request);
+	}
+
+	cvRun.notify_all();
+	return true;
+}
+
+// message thread
+bool Debugger::ExpandVariable(std::shared_ptr<ExpandVariableContext> expandContext) {
+	if (!blocking) {
+		return false;
+	}
+	{
+		std::unique_lock<std::mutex> lock(evalMtx);
+		EvalRequest request;
+		request.expand = expandContext;
+		evalQueue.push(request);
+	}
+
+	cvRun.notify_all();
+	return true;
+}
+
+int LastLevel(lua_State *L) {
 	int level = 0;
 
 	lua_Debug ar;
@@ -911,535 +1453,437 @@ int LastLevel(lua_State *L) {
 	return level;
 }
 
-// host thread
-bool Debugger::DoEval(std::shared_ptr<EvalContext> evalContext) {
-	if (!currentL || !evalContext) {
+bool Debugger::LoadEvalChunk(lua_State *L, const std::string &statement) {
+	std::string key = std::to_string(static_cast<int>(luaVersion));
+	key.push_back(':');
+	key.append(statement);
+
+	lua_getfield(L, LUA_REGISTRYINDEX, EVAL_CHUNK_TABLE_NAME);// 1: chunkTable|nil
+	if (lua_type(L, -1) != LUA_TTABLE || evalChunkCount >= EVAL_CHUNK_CACHE_LIMIT) {
+		lua_pop(L, 1);
+		lua_newtable(L);
+		lua_pushvalue(L, -1);
+		lua_setfield(L, LUA_REGISTRYINDEX, EVAL_CHUNK_TABLE_NAME);// 1: chunkTable
+		evalChunkCount = 0;
+	}
+	lua_getfield(L, -1, key.c_str());// 1: chunkTable, 2: chunk|nil
+	if (lua_type(L, -1) == LUA_TFUNCTION) {
+		lua_remove(L, -2);
+		return true;
+	}
+	lua_pop(L, 1);
+
+	if (luaL_loadstring(L, statement.c_str()) != LUA_OK) {
+		lua_pop(L, 2);
 		return false;
 	}
+	// 1: chunkTable, 2: chunk
+	lua_pushvalue(L, -1);
+	lua_setfield(L, -3, key.c_str());
+	lua_remove(L, -2);
+	evalChunkCount++;
+	return true;
+}
 
+lua_State *Debugger::GetEvalState(int &stackLevel) {
 	auto L = currentL;
-
-	int innerLevel = evalContext->stackLevel;
-
 	while (L != nullptr) {
 		int level = LastLevel(L);
-		if (innerLevel > level) {
-			innerLevel -= level;
+		if (stackLevel >= level) {
+			stackLevel -= level;
 			L = manager->extension.QueryParentThread(L);
 		} else {
 			break;
 		}
 	}
+	return L;
+}
 
-	if (L == nullptr) {
+// 压入求值环境并记录位置
+bool Debugger::PushEvalEnv(lua_State *L, int stackLevel, EvalEnv &env) {
+	env.lazy = PushLazyEnv(L, stackLevel, env.frame);
+	if (!env.lazy && !CreateEnv(L, stackLevel)) {
 		return false;
 	}
+	env.index = lua_gettop(L);
+	return true;
+}
 
-	//auto* const L = L;
-	// From "cacheId"
-	if (evalContext->cacheId > 0) {
-		lua_getfield(L, LUA_REGISTRYINDEX, CACHE_TABLE_NAME);// 1: cacheTable|nil
-		if (lua_type(L, -1) == LUA_TTABLE) {
-			lua_getfield(L, -1, std::to_string(evalContext->cacheId).c_str());// 1: cacheTable, 2: value
-			SetVariableArena(evalContext->result.GetArena());
-			GetVariable(L, evalContext->result, -1, evalContext->depth);
-			ClearVariableArenaRef();
-			lua_pop(L, 2);
-			return true;
-		}
-		lua_pop(L, 1);
-	}
-	// LOAD AS "return expr"
-	std::string statement = "return ";
-	if (evalContext->setValue) {
-		statement = evalContext->expr + " = " + evalContext->value + " return " + evalContext->expr;
-	} else {
-		statement.append(evalContext->expr);
+// host thread
+bool Debugger::DoEval(std::shared_ptr<EvalContext> evalContext) {
+	if (!evalContext) {
+		return false;
 	}
+	return DoEval(*evalContext, evalContext->expr);
+}
 
-	// 如果是 aaa:bbbb 则纠正为aaa.bbbb
-	int r = luaL_loadstring(L, statement.c_str());
-	if (r == LUA_ERRSYNTAX) {
-		evalContext->error = "syntax err: ";
-		evalContext->error.append(evalContext->expr);
+bool Debugger::DoEval(EvalContext &evalContext, const std::string &expr) {
+	if (!currentL) {
 		return false;
 	}
-	// call
-	const int fIdx = lua_gettop(L);
-	// create env
-	if (!CreateEnv(L, innerLevel))
+
+	int innerLevel = evalContext.stackLevel;
+	auto L = GetEvalState(innerLevel);
+	if (L == nullptr) {
 		return false;
-	// setup env
-#ifndef EMMY_USE_LUA_SOURCE
-	lua_setfenv(L, fIdx);
-#elif defined(EMMY_LUA_51) || defined(EMMY_LUA_JIT)
-    lua_setfenv(L, fIdx);
-#else //52 & 53
-    lua_setupvalue(L, fIdx, 1);
-#endif
-	assert(lua_gettop(L) == fIdx);
-	// call function() return expr end
-	r = lua_pcall(L, 0, 1, 0);
-	if (r == LUA_OK) {
-		evalContext->result->name = evalContext->expr;
-		SetVariableArena(evalContext->result.GetArena());
-		GetVariable(L, evalContext->result, -1, evalContext->depth);
-		ClearVariableArenaRef();
-		lua_pop(L, 1);
-		return true;
-	}
-	if (r == LUA_ERRRUN) {
-		evalContext->error = lua_tostring(L, -1);
 	}
 
-	lua_pop(L, 1);
-	return false;
+	const int top = lua_gettop(L);
+	EvalEnv env;
+	const bool suc = DoEval(L, innerLevel, evalContext, expr, env);
+	lua_settop(L, top);
+	return suc;
 }
 
-struct LogMessageReplaceExpress {
-public:
-	LogMessageReplaceExpress(std::string &&expr, std::size_t startIndex, std::size_t endIndex, bool needEval)
-		: Expr(expr),
-		  StartIndex(startIndex),
-		  EndIndex(endIndex),
-		  NeedEval(needEval) {
+// host thread
+void Debugger::DoBatchEval(std::shared_ptr<BatchEvalContext> batchContext) {
+	if (!currentL || !batchContext) {
+		return;
 	}
 
-	std::string Expr;
-	std::size_t StartIndex;
-	std::size_t EndIndex;
-	bool NeedEval;
-};
+	int innerLevel = batchContext->stackLevel;
+	auto L = GetEvalState(innerLevel);
+	if (L == nullptr) {
+		return;
+	}
 
-std::string BaseName(const std::string &filePath) {
-	std::size_t sepIndex = filePath.find_last_of('/');
-	if (sepIndex == std::string::npos) {
-		sepIndex = filePath.find_last_of('\\');
-		if (sepIndex != std::string::npos) {
-			return filePath.substr(sepIndex + 1);
-		}
-		return filePath;
-	} else {
-		return filePath.substr(sepIndex + 1);
+	// 所有表达式共用一个环境, 栈帧只查找一次
+	const int top = lua_gettop(L);
+	EvalEnv env;
+	for (auto &evalContext: batchContext->evals) {
+		evalContext->success = DoEval(L, innerLevel, *evalContext, evalContext->expr, env);
 	}
+	lua_settop(L, top);
 }
 
-void Debugger::DoLogMessage(std::shared_ptr<BreakPoint> bp) {
-	std::string &logMessage = bp->logMessage;
-	// 为什么不用regex?
-	// 因为gcc 4.8 regex还是空实现
-	// 而且后续版本的gcc中正则表达式行为似乎也不太正常
-	enum class ParseState {
-		Normal,
-		LeftBrace,
-		RightBrace
-	} state = ParseState::Normal;
-
-	std::vector<LogMessageReplaceExpress> replaceExpresses;
-
-
-	std::size_t leftBraceBegin = 0;
-
-	std::size_t rightBraceBegin = 0;
-
-	// 如果在表达式中出现左大括号
-	std::size_t exprLeftCount = 0;
-
-
-	for (std::size_t index = 0; index != logMessage.size(); index++) {
-		char ch = logMessage[index];
-
-		switch (state) {
-			case ParseState::Normal: {
-				if (ch == '{') {
-					state = ParseState::LeftBrace;
-					leftBraceBegin = index;
-					exprLeftCount = 0;
-				} else if (ch == '}') {
-					state = ParseState::RightBrace;
-					rightBraceBegin = index;
-				}
-				break;
-			}
-			case ParseState::LeftBrace: {
-				if (ch == '{') {
-					// 认为是左双大括号转义为可见的'{'
-					if (index == leftBraceBegin + 1) {
-						replaceExpresses.emplace_back("{", leftBraceBegin, index, false);
-						state = ParseState::Normal;
-					} else {
-						exprLeftCount++;
-					}
-				} else if (ch == '}') {
-					// 认为是表达式内的大括号
-					if (exprLeftCount > 0) {
-						exprLeftCount--;
-						continue;
-					}
-
-					replaceExpresses.emplace_back(logMessage.substr(leftBraceBegin + 1, index - leftBraceBegin - 1),
-					                              leftBraceBegin, index, true);
-
-
-					state = ParseState::Normal;
-				}
-				break;
-			}
-			case ParseState::RightBrace: {
-				if (ch == '}' && (index == rightBraceBegin + 1)) {
-					replaceExpresses.emplace_back("}", rightBraceBegin, index, false);
-				} else {
-					//认为左右大括号失配，之前的不做处理，退格一位回去重新判断
-					index--;
-				}
-				state = ParseState::Normal;
-				break;
-			}
-		}
+// host thread
+void Debugger::DoStackVariables(std::shared_ptr<StackVariablesContext> stackContext) {
+	if (!currentL || !stackContext) {
+		return;
 	}
 
-	std::stringstream message;
-
-	if (replaceExpresses.empty()) {
-		message << logMessage;
-	} else {
-		// 拼接字符串
-		// 怎么replace 函数都没有啊
-
-		std::size_t start = 0;
-		for (std::size_t index = 0; index != replaceExpresses.size(); index++) {
-			auto &replaceExpress = replaceExpresses[index];
-			if (start < replaceExpress.StartIndex) {
-				auto fragment = logMessage.substr(start, replaceExpress.StartIndex - start);
-				message << fragment;
-				start = replaceExpress.StartIndex;
-			}
-
-			if (replaceExpress.NeedEval) {
-				auto ctx = std::make_shared<EvalContext>();
-				ctx->expr = std::move(replaceExpress.Expr);
-				ctx->depth = 1;
-				bool succeed = DoEval(ctx);
-				if (succeed) {
-					message << ctx->result->value;
-				} else {
-					message << ctx->error;
-				}
-			} else {
-				message << replaceExpress.Expr;
-			}
-
-			start = replaceExpress.EndIndex + 1;
-		}
-
-		if (start < logMessage.size()) {
-			auto fragment = logMessage.substr(start, logMessage.size() - start);
-			message << fragment;
-		}
+	int innerLevel = stackContext->stackLevel;
+	auto L = GetEvalState(innerLevel);
+	lua_Debug ar{};
+	if (L == nullptr || !lua_getstack(L, innerLevel, &ar) || !lua_getinfo(L, "nSlu", &ar)) {
+		return;
 	}
 
-	std::string baseName = BaseName(bp->file);
+	auto &stack = stackContext->stack;
+	stack.file = GetFile(&ar);
+	stack.functionName = getDebugName(&ar) == nullptr ? "" : getDebugName(&ar);
+	stack.level = stackContext->stackLevel;
+	stack.line = getDebugCurrentLine(&ar);
+	stackArena->Clear();
+	stack.variableArena = stackArena;
+	GetStackVariables(L, &ar, stack);
+	stackContext->success = true;
+}
 
-	EmmyFacade::Get().SendLog(LogType::Info, "[%s:%d] %s", baseName.c_str(), bp->line, message.str().c_str());
+bool IsArrayKey(lua_State *L, int keyIndex, int64_t arraySize) {
+	if (lua_type(L, keyIndex) != LUA_TNUMBER) {
+		return false;
+	}
+	const auto number = lua_tonumber(L, keyIndex);
+	return number >= 1 && number <= static_cast<lua_Number>(arraySize)
+		&& static_cast<lua_Number>(static_cast<int64_t>(number)) == number;
 }
 
-std::shared_ptr<BreakPoint> Debugger::FindBreakPoint(lua_Debug *ar) {
+// host thread
+void Debugger::DoExpandVariable(std::shared_ptr<ExpandVariableContext> expandContext) {
+	auto &ctx = *expandContext;
+	ctx.done = true;
 	if (!currentL) {
-		return nullptr;
+		ctx.success = false;
+		ctx.error = "no lua state";
+		return;
 	}
 
 	auto L = currentL;
-
-	const int cl = getDebugCurrentLine(ar);
-	auto lineSet = manager->GetLineSet();
-
-	if (cl >= 0 && lineSet.find(cl) != lineSet.end()) {
-		lua_getinfo(L, "S", ar);
-		const auto chunkname = GetFile(ar);
-		return FindBreakPoint(chunkname, cl);
+	const int top = lua_gettop(L);
+	if (!variableCache.Push(L, ctx.cacheId)) {// 1: value
+		ctx.success = false;
+		ctx.error = "variable is no longer available";
+		return;
 	}
-	return nullptr;
-}
-
-std::shared_ptr<BreakPoint> Debugger::FindBreakPoint(const std::string &chunkname, int line) {
-	std::shared_ptr<BreakPoint> breakedpoint = nullptr;
-	int maxMatchProcess = 0;
-
-	auto breakpoints = manager->GetBreakpoints();
-	for (const auto bp: breakpoints) {
-		if (bp->line == line) {
-			// fuzz match: bp(x/a/b/c), file(a/b/c)
-			int matchProcess = FuzzyMatchFileName(chunkname, bp->file);
+	if (lua_type(L, -1) != LUA_TTABLE) {
+		ctx.success = false;
+		ctx.error = "variable is not a table";
+		lua_settop(L, top);
+		return;
+	}
+	const int table = lua_gettop(L);
+	ctx.success = true;
 
-			if (matchProcess > 0 && matchProcess > maxMatchProcess) {
-				maxMatchProcess = matchProcess;
-				breakedpoint = bp;
-			}
+	if (!ctx.started) {
+		ctx.started = true;
+		ctx.arraySize = static_cast<int64_t>(lua_rawlen(L, table));
+		ctx.arrayNext = (std::min)((std::max)(ctx.arrayOffset, int64_t(0)), ctx.arraySize);
+		ctx.arrayEnd = ctx.arraySize;
+		if (ctx.arrayLimit >= 0) {
+			ctx.arrayEnd = (std::min)(ctx.arrayNext + ctx.arrayLimit, ctx.arraySize);
 		}
+		ctx.hashSkip = (std::max)(ctx.hashOffset, int64_t(0));
+	}
+
+	const int chunkSize = (std::max)(manager->expandChunkSize.load(), 1);
+	const auto deadline = std::chrono::steady_clock::now()
+		+ std::chrono::milliseconds(manager->expandTimeBudget.load());
+	// 每次至少前进一步, 预算过小时也不会停住
+	int steps = 0;
+	auto pause = [&]() {
+		return ctx.children.size() >= static_cast<std::size_t>(chunkSize)
+			|| (steps > 0 && std::chrono::steady_clock::now() >= deadline);
+	};
+
+	ctx.chunkArrayOffset = ctx.arrayNext;
+	ctx.chunkHashOffset = (std::max)(ctx.hashRead, ctx.hashSkip);
+	SetVariableArena(ctx.GetArena());
+
+	// 数组部分
+	while (ctx.arrayNext < ctx.arrayEnd && !pause()) {
+		lua_rawgeti(L, table, ctx.arrayNext + 1);
+		auto v = ctx.GetArena()->Alloc();
+		ValueFormatter formatter;
+		formatter.AppendInteger(ctx.arrayNext + 1);
+		v.SetName(formatter.Data(), formatter.Size());
+		v.SetNameType(LUA_TNUMBER);
+		GetVariable(L, v, -1, ctx.depth);
+		ctx.children.push_back(v);
+		lua_pop(L, 1);
+		ctx.arrayNext++;
+		steps++;
 	}
 
-	return breakedpoint;
-}
-
-#undef min
-bool Debugger::DoHitCondition(std::shared_ptr<BreakPoint> bp) {
-	auto &hitCondition = bp->hitCondition;
-
-	enum class ParseState {
-		ExpectedOperator,
-		// 大于
-		Gt,
-		// 小于
-		Le,
-		// 单等号 
-		Eq,
-
-		ExpectedHitTimes,
-
-		ParseDigit,
-
-		ParseFinish
-	} state = ParseState::ExpectedOperator;
-
-	enum class Operator {
-		// 大于
-		Gt,
-		// 小于
-		Le,
-		// 小于等于
-		LeEq,
-		// 大于等于
-		GtEq,
-		// 双等号
-		EqEq,
-	} evalOperator = Operator::EqEq;
-
-	unsigned long long hitTimes = 0;
-
-	for (std::size_t index = 0; index != hitCondition.size(); index++) {
-		char ch = hitCondition[index];
-
-		switch (state) {
-			case ParseState::ExpectedOperator: {
-				if (ch == ' ') {
-					continue;
-				}
-
-				if (ch == '=') {
-					state = ParseState::Eq;
-				} else if (ch == '<') {
-					state = ParseState::Le;
-				} else if (ch == '>') {
-					state = ParseState::Gt;
-				} else {
-					return false;
-				}
-
-				break;
+	// 哈希部分, 从上次停下的键继续 lua_next
+	bool hashDone = ctx.hashLimit == 0;
+	if (ctx.arrayNext >= ctx.arrayEnd && !hashDone) {
+		const int64_t hashEnd = ctx.hashLimit < 0 ? -1 : (std::max)(ctx.hashOffset, int64_t(0)) + ctx.hashLimit;
+		if (ctx.cursorId == 0 || !variableCache.Push(L, ctx.cursorId)) {// 2: key|nil
+			lua_pushnil(L);
+			// 游标丢失(weak 模式下被回收或槽位用完)时与键被删除相同处理
+			if (ctx.hashRead > 0) {
+				ctx.hashSkip = (std::max)(ctx.hashRead, ctx.hashSkip);
+				ctx.hashRead = 0;
 			}
-			case ParseState::Eq: {
-				if (ch == '=') {
-					evalOperator = Operator::EqEq;
-					state = ParseState::ExpectedHitTimes;
-				} else {
-					return false;
-				}
-				break;
+			ctx.cursorId = 0;
+		} else {
+			// 键被删除后不能再用于 lua_next, 从头开始并跳过已读取的部分
+			lua_pushvalue(L, -1);
+			lua_rawget(L, table);
+			const bool removed = lua_isnil(L, -1);
+			lua_pop(L, 1);
+			if (removed) {
+				lua_pop(L, 1);
+				lua_pushnil(L);
+				ctx.hashSkip = (std::max)(ctx.hashRead, ctx.hashSkip);
+				ctx.hashRead = 0;
 			}
-			case ParseState::Gt: {
-				if (ch == '=') {
-					evalOperator = Operator::GtEq;
-					state = ParseState::ExpectedHitTimes;
-				} else if (isdigit(ch)) {
-					evalOperator = Operator::Gt;
-					hitTimes = ch - '0';
-					state = ParseState::ParseDigit;
-				} else if (ch == ' ') {
-					evalOperator = Operator::Gt;
-					state = ParseState::ExpectedHitTimes;
-				} else {
-					return false;
-				}
+		}
+
+		while (true) {
+			if (hashEnd >= 0 && ctx.hashRead >= hashEnd) {
+				hashDone = true;
 				break;
 			}
-			case ParseState::Le: {
-				if (ch == '=') {
-					evalOperator = Operator::LeEq;
-					state = ParseState::ExpectedHitTimes;
-				} else if (isdigit(ch)) {
-					evalOperator = Operator::Le;
-					hitTimes = ch - '0';
-					state = ParseState::ParseDigit;
-				} else if (ch == ' ') {
-					evalOperator = Operator::Gt;
-					state = ParseState::ExpectedHitTimes;
-				} else {
-					return false;
+			if (pause()) {
+				// 保存当前键, 下一块从这里继续
+				if (ctx.cursorId == 0 || !variableCache.Replace(L, ctx.cursorId, -1)) {
+					ctx.cursorId = variableCache.Store(L, -1, manager->weakCache);
 				}
 				break;
 			}
-			case ParseState::ExpectedHitTimes: {
-				if (ch == ' ') {
-					continue;
-				} else if (isdigit(ch)) {
-					hitTimes = ch - '0';
-					state = ParseState::ParseDigit;
-				} else {
-					return false;
-				}
+			if (!lua_next(L, table)) {
+				hashDone = true;
 				break;
 			}
-			case ParseState::ParseDigit: {
-				if (isdigit(ch)) {
-					hitTimes = hitTimes * 10 + (ch - '0');
-				} else if (ch == ' ') {
-					state = ParseState::ParseFinish;
-				} else {
-					return false;
-				}
-
-				break;
+			// k: -2, v: -1
+			steps++;
+			if (IsArrayKey(L, -2, ctx.arraySize)) {
+				lua_pop(L, 1);
+				continue;
 			}
-			case ParseState::ParseFinish: {
-				if (ch == ' ') {
-					break;
-				} else {
-					return false;
-				}
-				break;
+			if (ctx.hashRead >= ctx.hashSkip) {
+				auto v = ctx.GetArena()->Alloc();
+				SetKeyName(L, -2, v);
+				GetVariable(L, v, -1, ctx.depth);
+				ctx.children.push_back(v);
 			}
+			ctx.hashRead++;
+			lua_pop(L, 1);
 		}
 	}
 
-	switch (evalOperator) {
-		case Operator::EqEq: {
-			return bp->hitCount == hitTimes;
-		}
-		case Operator::Gt: {
-			return bp->hitCount > hitTimes;
-		}
-		case Operator::GtEq: {
-			return bp->hitCount >= hitTimes;
-		}
-		case Operator::Le: {
-			return bp->hitCount < hitTimes;
+	ClearVariableArenaRef();
+	ctx.done = ctx.arrayNext >= ctx.arrayEnd && hashDone;
+	if (ctx.done && ctx.cursorId != 0) {
+		variableCache.Release(L, ctx.cursorId);
+		ctx.cursorId = 0;
+	}
+	lua_settop(L, top);
+}
+
+// 结果使用后出栈, 环境留在栈上供后续求值使用
+bool Debugger::DoEval(lua_State *L, int stackLevel, EvalContext &evalContext, const std::string &expr, EvalEnv &env) {
+	// From "cacheId"
+	if (evalContext.cacheId > 0) {
+		// 之前中断或已释放的 cacheId 不会找到其他值
+		if (!variableCache.Push(L, evalContext.cacheId)) {// 1: value
+			evalContext.error = "variable is no longer available";
+			return false;
 		}
-		case Operator::LeEq: {
-			return bp->hitCount <= hitTimes;
+		SetVariableArena(evalContext.result.GetArena());
+		GetVariable(L, evalContext.result, -1, evalContext.depth);
+		ClearVariableArenaRef();
+		lua_pop(L, 1);
+		return true;
+	}
+	// 简单的变量路径直接读取, 不编译chunk 也不创建环境
+	if (!evalContext.setValue) {
+		VariablePath path;
+		lua_Debug ar{};
+		if (VariablePath::Parse(expr, path) && lua_getstack(L, stackLevel, &ar) && path.Push(L, &ar)) {
+			evalContext.result.SetName(expr);
+			SetVariableArena(evalContext.result.GetArena());
+			GetVariable(L, evalContext.result, -1, evalContext.depth);
+			ClearVariableArenaRef();
+			lua_pop(L, 1);
+			return true;
 		}
 	}
+	// LOAD AS "return expr"
+	std::string statement = "return ";
+	if (evalContext.setValue) {
+		statement = expr + " = " + evalContext.value + " return " + expr;
+	} else {
+		statement.append(expr);
+	}
 
+	// create env
+	if (env.index == 0 && !PushEvalEnv(L, stackLevel, env)) {
+		return false;
+	}
 
+	// 如果是 aaa:bbbb 则纠正为aaa.bbbb
+	if (!LoadEvalChunk(L, statement)) {
+		evalContext.error = "syntax err: ";
+		evalContext.error.append(expr);
+		return false;
+	}
+	// call
+	const int fIdx = lua_gettop(L);
+	// setup env
+	lua_pushvalue(L, env.index);
+#ifndef EMMY_USE_LUA_SOURCE
+	lua_setfenv(L, fIdx);
+#elif defined(EMMY_LUA_51) || defined(EMMY_LUA_JIT)
+    lua_setfenv(L, fIdx);
+#else //52 & 53
+    lua_setupvalue(L, fIdx, 1);
+#endif
+	assert(lua_gettop(L) == fIdx);
+	// call function() return expr end
+	EvalSandbox sandbox(manager->evalInstructionLimit, manager->evalMemoryLimit);
+	const auto previousFrame = currentEvalFrame;
+	currentEvalFrame = env.lazy ? &env.frame : nullptr;
+	const bool suc = sandbox.Call(L, evalContext.error);
+	currentEvalFrame = previousFrame;
+	if (suc) {
+		evalContext.result.SetName(expr);
+		SetVariableArena(evalContext.result.GetArena());
+		GetVariable(L, evalContext.result, -1, evalContext.depth);
+		ClearVariableArenaRef();
+		lua_pop(L, 1);
+		return true;
+	}
 	return false;
 }
 
-
-// 重写模糊匹配算法
-int Debugger::FuzzyMatchFileName(const std::string &chunkName, const std::string &fileName) const {
-	auto chunkSize = chunkName.size();
-	auto fileSize = fileName.size();
-
-
-	std::size_t chunkExtSize = 0;
-	std::size_t fileExtSize = 0;
-	// trim 掉后缀
-	for (const auto &ext: manager->extNames) {
-		if (EndWith(chunkName, ext)) {
-			if (ext.size() > chunkExtSize) {
-				chunkExtSize = ext.size();
-			}
+void Debugger::DoLogMessage(std::shared_ptr<BreakPoint> bp) {
+	auto logTemplate = bp->logTemplate;
+	if (!logTemplate) {
+		logTemplate = std::make_shared<LogTemplate>(bp->file, bp->line, bp->logMessage);
+	}
+
+	// 缓冲区在多次命中间复用
+	logBuffer.clear();
+	logBuffer.reserve(logTemplate->GetLiteralSize());
+	logBuffer.append(logTemplate->GetPrefix());
+	scratchArena->Clear();
+	for (auto &segment: logTemplate->GetSegments()) {
+		if (!segment.isExpr) {
+			logBuffer.append(segment.text);
+			continue;
 		}
-
-		if (EndWith(fileName, ext)) {
-			if (ext.size() > fileExtSize) {
-				fileExtSize = ext.size();
-			}
+		scratchEvalContext.Reset();
+		scratchEvalContext.depth = 1;
+		if (DoEval(scratchEvalContext, segment.text)) {
+			logBuffer.append(scratchEvalContext.result.GetValue());
+		} else {
+			logBuffer.append(scratchEvalContext.error);
 		}
 	}
 
-	chunkSize -= chunkExtSize;
-	fileSize -= fileExtSize;
-
-	// 我们用chunkname去匹配filename
-	int maxMatchSize = static_cast<int>(std::min(chunkSize, fileSize));
-
-	int matchProcess = 1;
-
-	for (int i = 1; i != maxMatchSize; i++) {
-		char cChar = chunkName[chunkSize - i];
-		char fChar = fileName[fileSize - i];
-
-		if (cChar != fChar) {
-			// 以下匹配顺序是有意义的，不要轻易改变
-
-			if (::tolower(cChar) == ::tolower(fChar)) {
-				continue;
-			}
-
-			// 认为来自编辑器的路径不会是相对路径
-			// chunkname有可能是(./aaaa)也可能是(aaa/./bbb)
-			// 并不匹配(../)的情况
-			// 因为 ../的路径意义并不唯一
-			if (cChar == '.') {
-				std::size_t cLastindex = chunkSize - i + 1;
-
-				if (cLastindex >= chunkSize) {
-					matchProcess = 0;
-					break;
-				}
-
-				char cLastChar = chunkName[cLastindex];
-				if (cLastChar != '/' && cLastChar != '\\') {
-					matchProcess = 0;
-					break;
-				}
-
-				// 该值可能为负数
-				int cNextIndex = static_cast<int>(chunkSize) - i - 1;
-				if (cNextIndex < 0) {
-					// 匹配已经完毕
-					break;
-				}
-
-				char cNextChar = chunkName[cNextIndex];
+	EmmyFacade::Get().SendLog(LogType::Info, logBuffer);
+}
 
-				// 那chunkname 就是 aaa./bbbb 那就不匹配
-				if (cNextChar != '/' && cNextChar != '\\') {
-					matchProcess = 0;
-					break;
-				}
+std::shared_ptr<BreakPoint> Debugger::FindBreakPoint(lua_Debug *ar) {
+	if (!currentL) {
+		return nullptr;
+	}
 
-				// 这里会消耗掉 next的匹配
-				i++;
+	auto L = currentL;
 
-				// 这里是指保持下一次循环时fChar不变
-				fileSize += 2;
-				continue;
-			}
+	const int cl = getDebugCurrentLine(ar);
+	if (cl < 0) {
+		return nullptr;
+	}
 
-			if (cChar == '/' || cChar == '\\') {
-				if (fChar == '/' || fChar == '\\') {
-					matchProcess++;
-					continue;
-				}
-				// 一些人会写出 require './aaaa' 这种代码
-				// 导致lua程序 的chunkname 给的是 .\\/aaaa.lua
+	const auto index = manager->AcquireBreakpointIndex();
+	if (!index->HasLine(cl)) {
+		return nullptr;
+	}
 
+	lua_getinfo(L, "S", ar);
+	auto &chunk = GetChunkFile(ar);
+	MatchBreakpointFiles(chunk, index);
+	return index->FindBreakPoint(chunk.breakpointFiles, cl);
+}
 
-				//保持fChar 下次循环时不变
-				fileSize++;
-				continue;
-			}
+void Debugger::MatchBreakpointFiles(ChunkFile &chunk, const BreakpointIndex *index) const {
+	if (chunk.breakpointVersion != index->GetVersion()) {
+		index->MatchFiles(chunk.file, chunk.breakpointFiles);
+		chunk.breakpointVersion = index->GetVersion();
+	}
+}
 
-			// 那就是不匹配
-			matchProcess = 0;
-			break;
-		}
+bool Debugger::ActivationHasBreakPoint(lua_State *L, int level) {
+	lua_Debug ar{};
+	if (!lua_getstack(L, level, &ar)) {
+		return true;
+	}
+	lua_getinfo(L, "S", &ar);
+	const int lineDefined = getDebugLineDefined(&ar);
+	// c 函数不会产生行事件，5.1 的尾调用也无法得知函数范围，都打开行事件
+	if (lineDefined < 0) {
+		return true;
 	}
 
-	return matchProcess;
+	const auto index = manager->AcquireBreakpointIndex();
+	auto &chunk = GetChunkFile(&ar);
+	MatchBreakpointFiles(chunk, index);
+	if (chunk.breakpointFiles.empty()) {
+		return false;
+	}
+	// main chunk 覆盖整个文件
+	if (lineDefined == 0) {
+		return index->HasBreakPointInRange(chunk.breakpointFiles, 0, INT_MAX);
+	}
+	return index->HasBreakPointInRange(chunk.breakpointFiles, lineDefined, getDebugLastLineDefined(&ar));
 }
 
+#undef min
+// 重写模糊匹配算法
 void Debugger::ExecuteWithSkipHook(const Executor &exec) {
 	const bool skip = skipHook;
 	skipHook = true;
@@ -1448,8 +1892,30 @@ void Debugger::ExecuteWithSkipHook(const Executor &exec) {
 }
 
 void Debugger::ExecuteOnLuaThread(const Executor &exec) {
-	std::unique_lock<std::mutex> lock(luaThreadMtx);
-	luaThreadExecutors.push_back(exec);
+	luaThreadExecutors.Push(std::make_pair(luaThreadExecutorsEpoch.load(std::memory_order_acquire), exec));
+	luaThreadExecutorsPending.store(true, std::memory_order_release);
+}
+
+int Debugger::Pump(lua_State *L) {
+	if (skipHook || !luaThreadExecutorsPending.load(std::memory_order_acquire)) {
+		return 0;
+	}
+	SetCurrentState(L);
+	return ProcessLuaThreadExecutors();
+}
+
+int Debugger::ProcessLuaThreadExecutors() {
+	// 先清除标记再取, 取的过程中入队的任务会重新设置标记
+	luaThreadExecutorsPending.exchange(false, std::memory_order_acq_rel);
+	int count = 0;
+	std::pair<uint64_t, Executor> executor;
+	while (luaThreadExecutors.Pop(executor)) {
+		if (executor.first == luaThreadExecutorsEpoch.load(std::memory_order_acquire)) {
+			ExecuteWithSkipHook(executor.second);
+			count++;
+		}
+	}
+	return count;
 }
 
 int Debugger::GetTypeFromName(const char* typeName) {
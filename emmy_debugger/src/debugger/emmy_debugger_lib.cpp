@@ -130,6 +130,15 @@ int registerTypeName(lua_State* L)
 	return 2;
 }
 
+// emmy.pump(): number
+// 虚拟机空闲时由宿主定期调用, 执行调试器推迟到lua 线程的任务
+int pump(lua_State* L)
+{
+	const int count = EmmyFacade::Get().Pump(L);
+	lua_pushnumber(L, count);
+	return 1;
+}
+
 int gc(lua_State* L)
 {
 	EmmyFacade::Get().OnLuaStateGC(L);
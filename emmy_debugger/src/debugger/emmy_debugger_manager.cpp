@@ -1,6 +1,120 @@
 ﻿#include "emmy_debugger/debugger/emmy_debugger_manager.h"
+#include "emmy_debugger/debugger/condition_predicate.h"
+#include "emmy_debugger/debugger/log_template.h"
+#include "emmy_debugger/debugger/hit_condition.h"
 #include "emmy_debugger/api/lua_version.h"
 #include "emmy_debugger/util.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#ifdef _WIN32
+#include <windows.h>
+#elif defined(__linux__)
+#include <linux/membarrier.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace {
+	// 回收方的重屏障让所有正在运行的线程都执行一次完整的内存屏障
+	// hook 线程记录版本后只需要阻止编译器重排, 平台不支持时退回到双方各自的 seq_cst 屏障
+#if defined(_WIN32)
+	bool InitProcessBarrier()
+	{
+		return true;
+	}
+
+	void ProcessBarrier()
+	{
+		FlushProcessWriteBuffers();
+	}
+#elif defined(__linux__) && defined(__NR_membarrier)
+	int membarrierCmd = 0;
+
+	bool InitProcessBarrier()
+	{
+		const long cmds = syscall(__NR_membarrier, MEMBARRIER_CMD_QUERY, 0);
+		if (cmds < 0)
+		{
+			return false;
+		}
+		if ((cmds & MEMBARRIER_CMD_PRIVATE_EXPEDITED)
+			&& syscall(__NR_membarrier, MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED, 0) == 0)
+		{
+			membarrierCmd = MEMBARRIER_CMD_PRIVATE_EXPEDITED;
+			return true;
+		}
+		// 老内核只有全局版本, 很慢但只在回收时调用
+		if (cmds & MEMBARRIER_CMD_SHARED)
+		{
+			membarrierCmd = MEMBARRIER_CMD_SHARED;
+			return true;
+		}
+		return false;
+	}
+
+	void ProcessBarrier()
+	{
+		syscall(__NR_membarrier, membarrierCmd, 0);
+	}
+#else
+	bool InitProcessBarrier()
+	{
+		return false;
+	}
+
+	void ProcessBarrier()
+	{
+	}
+#endif
+
+	bool HasProcessBarrier()
+	{
+		static const bool available = InitProcessBarrier();
+		return available;
+	}
+
+	// hook 线程记录版本之后, 读取共享数据之前调用
+	void ReaderBarrier()
+	{
+		if (HasProcessBarrier())
+		{
+			std::atomic_signal_fence(std::memory_order_seq_cst);
+		}
+		else
+		{
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+		}
+	}
+
+	// 回收方发布新版本之后, 读取 hook 线程的记录之前调用
+	void ReclaimerBarrier()
+	{
+		if (HasProcessBarrier())
+		{
+			ProcessBarrier();
+		}
+		else
+		{
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+		}
+	}
+
+	// hook 线程最近一次查找的结果
+	struct HookDebuggerCache
+	{
+		const EmmyDebuggerManager* manager = nullptr;
+		lua_State* L = nullptr;
+		uint64_t version = 0;
+		Debugger* debugger = nullptr;
+		// 本线程在 HookScope 中记录的版本, 注册到 readerManager
+		std::shared_ptr<EmmyDebuggerManager::HookReader> reader;
+		const EmmyDebuggerManager* readerManager = nullptr;
+		int scopeDepth = 0;
+	};
+
+	thread_local HookDebuggerCache hookDebuggerCache;
+}
 
 EmmyDebuggerManager::EmmyDebuggerManager()
 	: stateBreak(std::make_shared<HookStateBreak>()),
@@ -9,9 +123,20 @@ EmmyDebuggerManager::EmmyDebuggerManager()
       stateStepOut(std::make_shared<HookStateStepOut>()),
 	  stateContinue(std::make_shared<HookStateContinue>()),
 	  stateStop(std::make_shared<HookStateStop>()),
-
+	  evalInstructionLimit(InitParams().evalInstructionLimit),
+	  evalMemoryLimit(InitParams().evalMemoryLimit),
+	  lazyStacks(false),
+	  expandChunkSize(InitParams().expandChunkSize),
+	  expandTimeBudget(InitParams().expandTimeBudget),
+	  tableChildrenLimit(0),
+	  weakCache(false),
+	  debuggersVersion(0),
+	  watchDepth(1),
+	  breakpointIndex(nullptr),
+	  breakpointIndexEpoch(0),
 	  isRunning(false)
 {
+	PublishBreakpointIndex();
 }
 
 EmmyDebuggerManager::~EmmyDebuggerManager()
@@ -33,6 +158,57 @@ std::shared_ptr<Debugger> EmmyDebuggerManager::GetDebugger(lua_State* L)
 	}
 }
 
+EmmyDebuggerManager::HookScope::HookScope(EmmyDebuggerManager& manager)
+{
+	auto& cache = hookDebuggerCache;
+	if (cache.scopeDepth++ > 0)
+	{
+		return;
+	}
+
+	if (cache.readerManager != &manager)
+	{
+		cache.reader = std::make_shared<HookReader>();
+		cache.readerManager = &manager;
+		std::lock_guard<std::mutex> lock(manager.debuggerMtx);
+		manager.hookReaders.push_back(cache.reader);
+	}
+	// 与回收方的版本递增和读取构成 store-load 顺序, 由 ReaderBarrier 和 ReclaimerBarrier 配对保证
+	// 回收方没有看到这里的记录时, 之后 GetHookDebugger 和 AcquireBreakpointIndex 一定看到新版本
+	cache.reader->debuggersEpoch.store(manager.debuggersVersion.load(std::memory_order_relaxed), std::memory_order_relaxed);
+	cache.reader->breakpointEpoch.store(manager.breakpointIndexEpoch.load(std::memory_order_relaxed), std::memory_order_relaxed);
+	ReaderBarrier();
+}
+
+EmmyDebuggerManager::HookScope::~HookScope()
+{
+	auto& cache = hookDebuggerCache;
+	if (--cache.scopeDepth == 0)
+	{
+		cache.reader->debuggersEpoch.store(UINT64_MAX, std::memory_order_release);
+		cache.reader->breakpointEpoch.store(UINT64_MAX, std::memory_order_release);
+	}
+}
+
+Debugger* EmmyDebuggerManager::GetHookDebugger(lua_State* L)
+{
+	auto& cache = hookDebuggerCache;
+	if (cache.L == L && cache.manager == this && cache.version == debuggersVersion.load(std::memory_order_acquire))
+	{
+		return cache.debugger;
+	}
+
+	std::vector<std::shared_ptr<Debugger>> reclaimed;
+	std::lock_guard<std::mutex> lock(debuggerMtx);
+	auto it = debuggers.find(GetUniqueIdentify(L));
+	cache.manager = this;
+	cache.L = L;
+	cache.version = debuggersVersion.load(std::memory_order_relaxed);
+	cache.debugger = it != debuggers.end() ? it->second.get() : nullptr;
+	ReclaimDebuggers(reclaimed);
+	return cache.debugger;
+}
+
 std::shared_ptr<Debugger> EmmyDebuggerManager::AddDebugger(lua_State* L)
 {
 	std::lock_guard<std::mutex> lock(debuggerMtx);
@@ -65,6 +241,7 @@ std::shared_ptr<Debugger> EmmyDebuggerManager::AddDebugger(lua_State* L)
 			debugger = std::make_shared<Debugger>(mainState, this);
 		}
 		debuggers.insert({identify, debugger});
+		debuggersVersion.fetch_add(1, std::memory_order_seq_cst);
 	}
 	else
 	{
@@ -78,6 +255,7 @@ std::shared_ptr<Debugger> EmmyDebuggerManager::AddDebugger(lua_State* L)
 
 std::shared_ptr<Debugger> EmmyDebuggerManager::RemoveDebugger(lua_State* L)
 {
+	std::vector<std::shared_ptr<Debugger>> reclaimed;
 	std::lock_guard<std::mutex> lock(debuggerMtx);
 	auto identify = GetUniqueIdentify(L);
 	auto it = debuggers.find(identify);
@@ -85,6 +263,9 @@ std::shared_ptr<Debugger> EmmyDebuggerManager::RemoveDebugger(lua_State* L)
 	{
 		auto debugger = it->second;
 		debuggers.erase(it);
+		const auto version = debuggersVersion.fetch_add(1, std::memory_order_seq_cst) + 1;
+		retiredDebuggers.emplace_back(version, debugger);
+		ReclaimDebuggers(reclaimed);
 		return debugger;
 	}
 	return nullptr;
@@ -103,8 +284,15 @@ std::vector<std::shared_ptr<Debugger>> EmmyDebuggerManager::GetDebuggers()
 
 void EmmyDebuggerManager::RemoveAllDebugger()
 {
+	std::vector<std::shared_ptr<Debugger>> reclaimed;
 	std::lock_guard<std::mutex> lock(debuggerMtx);
+	const auto version = debuggersVersion.fetch_add(1, std::memory_order_seq_cst) + 1;
+	for (auto& it : debuggers)
+	{
+		retiredDebuggers.emplace_back(version, it.second);
+	}
 	debuggers.clear();
+	ReclaimDebuggers(reclaimed);
 }
 
 std::shared_ptr<Debugger> EmmyDebuggerManager::GetHitBreakpoint()
@@ -127,6 +315,15 @@ bool EmmyDebuggerManager::IsDebuggerEmpty()
 
 void EmmyDebuggerManager::AddBreakpoint(std::shared_ptr<BreakPoint> breakpoint)
 {
+	breakpoint->conditionPredicate = ConditionPredicate::Compile(breakpoint->condition);
+	if (!breakpoint->hitCondition.empty()) {
+		breakpoint->hitConditionPredicate = std::make_shared<HitCondition>(breakpoint->hitCondition);
+	}
+	if (!breakpoint->logMessage.empty()) {
+		breakpoint->logTemplate = std::make_shared<LogTemplate>(breakpoint->file, breakpoint->line,
+		                                                        breakpoint->logMessage);
+	}
+
 	std::lock_guard<std::mutex> lock(breakpointsMtx);
 	bool isAdd = false;
 	for (std::shared_ptr<BreakPoint>& bp : breakpoints)
@@ -143,7 +340,7 @@ void EmmyDebuggerManager::AddBreakpoint(std::shared_ptr<BreakPoint> breakpoint)
 		breakpoints.push_back(breakpoint);
 	}
 
-	RefreshLineSet();
+	PublishBreakpointIndex();
 }
 
 std::vector<std::shared_ptr<BreakPoint>> EmmyDebuggerManager::GetBreakpoints()
@@ -166,29 +363,115 @@ void EmmyDebuggerManager::RemoveBreakpoint(const std::string& file, int line)
 		}
 		++it;
 	}
-	RefreshLineSet();
+	PublishBreakpointIndex();
 }
 
 void EmmyDebuggerManager::RemoveAllBreakpoints()
 {
 	std::lock_guard<std::mutex> lock(breakpointsMtx);
 	breakpoints.clear();
-	lineSet.clear();
+	PublishBreakpointIndex();
 }
 
-void EmmyDebuggerManager::RefreshLineSet()
+void EmmyDebuggerManager::SetExtNames(const std::vector<std::string>& exts)
 {
-	lineSet.clear();
-	for (auto bp : breakpoints)
+	std::lock_guard<std::mutex> lock(breakpointsMtx);
+	extNames = exts;
+	PublishBreakpointIndex();
+}
+
+const BreakpointIndex* EmmyDebuggerManager::AcquireBreakpointIndex()
+{
+	// HookScope 进入时已记录版本, scope 内读到的索引都不早于该版本
+	return breakpointIndex.load(std::memory_order_acquire);
+}
+
+void EmmyDebuggerManager::PublishBreakpointIndex()
+{
+	// 发布者之间由 breakpointsMtx 串行, 新版本号即为发布后的 epoch
+	const auto epoch = breakpointIndexEpoch.load(std::memory_order_relaxed) + 1;
+	std::shared_ptr<const BreakpointIndex> index = std::make_shared<BreakpointIndex>(breakpoints, extNames, epoch);
+	auto retired = currentBreakpointIndex;
+	currentBreakpointIndex = index;
+
+	breakpointIndex.store(index.get(), std::memory_order_release);
+	breakpointIndexEpoch.store(epoch, std::memory_order_release);
+
+	if (retired)
 	{
-		lineSet.insert(bp->line);
+		retiredBreakpointIndexes.emplace_back(epoch, retired);
 	}
+	ReclaimBreakpointIndexes();
 }
 
-std::set<int> EmmyDebuggerManager::GetLineSet()
+void EmmyDebuggerManager::ReclaimBreakpointIndexes()
 {
-	std::lock_guard<std::mutex> lock(breakpointsMtx);
-	return lineSet;
+	if (retiredBreakpointIndexes.empty())
+	{
+		return;
+	}
+
+	// 按线程记录, 已移除但还在 hook 中的 debugger 也被计入, 不在 hook 中的线程不阻止回收
+	ReclaimerBarrier();
+	uint64_t minEpoch = UINT64_MAX;
+	{
+		std::lock_guard<std::mutex> lock(debuggerMtx);
+		for (auto& reader : hookReaders)
+		{
+			minEpoch = (std::min)(minEpoch, reader->breakpointEpoch.load(std::memory_order_acquire));
+		}
+	}
+
+	auto it = retiredBreakpointIndexes.begin();
+	while (it != retiredBreakpointIndexes.end())
+	{
+		if (it->first <= minEpoch)
+		{
+			it = retiredBreakpointIndexes.erase(it);
+		}
+		else
+		{
+			++it;
+		}
+	}
+}
+
+void EmmyDebuggerManager::ReclaimDebuggers(std::vector<std::shared_ptr<Debugger>>& reclaimed)
+{
+	if (retiredDebuggers.empty())
+	{
+		return;
+	}
+
+	ReclaimerBarrier();
+	uint64_t minEpoch = UINT64_MAX;
+	auto reader = hookReaders.begin();
+	while (reader != hookReaders.end())
+	{
+		// 只剩这里的引用说明线程已经退出
+		if (reader->use_count() == 1)
+		{
+			reader = hookReaders.erase(reader);
+			continue;
+		}
+		minEpoch = (std::min)(minEpoch, (*reader)->debuggersEpoch.load(std::memory_order_acquire));
+		++reader;
+	}
+
+	// 进入 HookScope 时已看到移除后版本的线程不会再用到它
+	auto it = retiredDebuggers.begin();
+	while (it != retiredDebuggers.end())
+	{
+		if (it->first <= minEpoch)
+		{
+			reclaimed.push_back(std::move(it->second));
+			it = retiredDebuggers.erase(it);
+		}
+		else
+		{
+			++it;
+		}
+	}
 }
 
 void EmmyDebuggerManager::HandleBreak(lua_State* L)
@@ -227,6 +510,61 @@ void EmmyDebuggerManager::Eval(std::shared_ptr<EvalContext> ctx)
 	}
 }
 
+void EmmyDebuggerManager::BatchEval(std::shared_ptr<BatchEvalContext> ctx)
+{
+	auto debugger = GetHitBreakpoint();
+	if (debugger)
+	{
+		debugger->BatchEval(ctx);
+	}
+}
+
+void EmmyDebuggerManager::StackVariables(std::shared_ptr<StackVariablesContext> ctx)
+{
+	auto debugger = GetHitBreakpoint();
+	if (debugger)
+	{
+		debugger->StackVariables(ctx);
+	}
+}
+
+void EmmyDebuggerManager::ExpandVariable(std::shared_ptr<ExpandVariableContext> ctx)
+{
+	auto debugger = GetHitBreakpoint();
+	if (debugger)
+	{
+		debugger->ExpandVariable(ctx);
+	}
+}
+
+void EmmyDebuggerManager::SetWatches(const std::vector<std::string>& exprs, int depth)
+{
+	std::lock_guard<std::mutex> lock(watchesMtx);
+	watches = exprs;
+	watchDepth = depth;
+}
+
+std::shared_ptr<BatchEvalContext> EmmyDebuggerManager::CreateWatchContext()
+{
+	std::lock_guard<std::mutex> lock(watchesMtx);
+	if (watches.empty())
+	{
+		return nullptr;
+	}
+	auto ctx = std::make_shared<BatchEvalContext>();
+	ctx->depth = watchDepth;
+	// 所有监视表达式的结果放在同一个 arena 中
+	auto arena = std::make_shared<VariableArena>();
+	for (auto& expr : watches)
+	{
+		auto eval = std::make_shared<EvalContext>(arena);
+		eval->expr = expr;
+		eval->depth = watchDepth;
+		ctx->evals.push_back(eval);
+	}
+	return ctx;
+}
+
 void EmmyDebuggerManager::OnDisconnect()
 {
 	SetRunning(false);
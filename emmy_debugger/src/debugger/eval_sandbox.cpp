@@ -0,0 +1,128 @@
+#include "emmy_debugger/debugger/eval_sandbox.h"
+#include <climits>
+#include "emmy_debugger/api/lua_version.h"
+
+namespace {
+const char *INSTRUCTION_LIMIT_ERROR = "eval timeout: instruction limit exceeded";
+// 空闲的求值协程, 使用期间从注册表中取出, 嵌套求值时会另建一个
+const char *EVAL_THREAD_NAME = "_emmy_eval_thread_";
+}
+
+EvalSandbox::EvalSandbox(int64_t instructionLimit, int64_t memoryLimit)
+	: instructionLimit(instructionLimit),
+	  memoryLimit(memoryLimit) {
+}
+
+bool EvalSandbox::Call(lua_State *L, std::string &error) {
+	const int fIdx = lua_gettop(L);
+	auto thread = AcquireThread(L);
+	lua_pushvalue(L, fIdx);
+	lua_xmove(L, thread, 1);
+
+	// 新协程会继承调试器的hook, 求值期间不能进入调试器
+	// luajit 的hook 是全局的, 设置到协程上也会替换调试器的hook, 所以完全不动
+	// 求值在调试器的hook 中进行, luajit 在hook 执行期间本身就不会再触发hook
+	bool isJit = false;
+#ifndef EMMY_USE_LUA_SOURCE
+	isJit = luaVersion == LuaVersion::LUA_JIT;
+#elif defined(EMMY_LUA_JIT)
+	isJit = true;
+#endif
+	if (!isJit) {
+		if (instructionLimit > 0) {
+			const int count = instructionLimit > INT_MAX ? INT_MAX : static_cast<int>(instructionLimit);
+			lua_sethook(thread, InstructionLimitHook, LUA_MASKCOUNT, count);
+		} else {
+			lua_sethook(thread, nullptr, 0, 0);
+		}
+	}
+
+	AllocState state{};
+	bool limitMemory = false;
+	if (memoryLimit > 0) {
+		state.alloc = lua_getallocf(L, &state.ud);
+		state.limit = memoryLimit;
+		if (state.alloc) {
+			lua_setallocf(L, LimitedAlloc, &state);
+			limitMemory = true;
+		}
+	}
+
+	const int r = Resume(thread, L);
+
+	if (limitMemory) {
+		lua_setallocf(L, state.alloc, state.ud);
+	}
+
+	if (r == LUA_OK) {
+		lua_settop(thread, 1);
+		lua_xmove(thread, L, 1);
+		lua_insert(L, fIdx);
+		lua_settop(thread, 0);
+		// 正常返回的协程可以再次启动, 出错或挂起的协程不放回
+		lua_pushvalue(L, fIdx + 1);
+		lua_setfield(L, LUA_REGISTRYINDEX, EVAL_THREAD_NAME);
+		lua_settop(L, fIdx);
+		return true;
+	}
+
+	if (r == LUA_YIELD) {
+		error = "eval error: attempt to yield from eval";
+	} else if (state.exceeded) {
+		// 库函数可能把分配失败转成普通错误
+		error = "eval error: memory limit exceeded (" + std::to_string(memoryLimit) + " bytes)";
+	} else if (lua_type(thread, -1) == LUA_TSTRING) {
+		error = lua_tostring(thread, -1);
+	} else {
+		error = "eval error";
+	}
+	lua_settop(L, fIdx - 1);
+	return false;
+}
+
+lua_State *EvalSandbox::AcquireThread(lua_State *L) {
+	lua_getfield(L, LUA_REGISTRYINDEX, EVAL_THREAD_NAME);
+	if (lua_type(L, -1) == LUA_TTHREAD) {
+		lua_pushnil(L);
+		lua_setfield(L, LUA_REGISTRYINDEX, EVAL_THREAD_NAME);
+		return lua_tothread(L, -1);
+	}
+	lua_pop(L, 1);
+	return lua_newthread(L);
+}
+
+void *EvalSandbox::LimitedAlloc(void *ud, void *ptr, size_t osize, size_t nsize) {
+	auto state = static_cast<AllocState *>(ud);
+	// ptr 为空时 osize 是对象类型, 不是大小
+	const int64_t oldSize = ptr ? static_cast<int64_t>(osize) : 0;
+	const int64_t newSize = static_cast<int64_t>(nsize);
+	// 只拒绝增长, lua 要求缩小和释放不能失败
+	if (newSize > oldSize && state->used + (newSize - oldSize) > state->limit) {
+		state->exceeded = true;
+		return nullptr;
+	}
+	void *block = state->alloc(state->ud, ptr, osize, nsize);
+	if (block || nsize == 0) {
+		state->used += newSize - oldSize;
+	}
+	return block;
+}
+
+void EvalSandbox::InstructionLimitHook(lua_State *L, lua_Debug *) {
+	lua_pushstring(L, INSTRUCTION_LIMIT_ERROR);
+	lua_error(L);
+}
+
+int EvalSandbox::Resume(lua_State *thread, lua_State *from) {
+#ifndef EMMY_USE_LUA_SOURCE
+	int nres = 0;
+	return lua_resume(thread, from, 0, &nres);
+#elif defined(EMMY_LUA_51) || defined(EMMY_LUA_JIT)
+	return lua_resume(thread, 0);
+#elif defined(EMMY_LUA_54)
+	int nres = 0;
+	return lua_resume(thread, from, 0, &nres);
+#else //52 & 53
+	return lua_resume(thread, from, 0);
+#endif
+}
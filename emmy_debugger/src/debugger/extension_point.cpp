@@ -6,7 +6,7 @@ std::string ExtensionPoint::ExtensionTable = "emmyHelper";
 int metaQuery(lua_State* L)
 {
 	const int argN = lua_gettop(L);
-	auto pVar = (Idx<Variable>*)lua_touserdata(L, 1);
+	auto pVar = (Variable*)lua_touserdata(L, 1);
 	const int index = 2;
 	const auto depth = lua_tonumber(L, 3);
 	bool queryHelper = false;
@@ -25,33 +25,33 @@ int metaQuery(lua_State* L)
 
 int metaAddChild(lua_State* L)
 {
-	auto* pVar = (Idx<Variable>*)lua_touserdata(L, 1);
-	auto* pChild = (Idx<Variable>*)lua_touserdata(L, 2);
+	auto* pVar = (Variable*)lua_touserdata(L, 1);
+	auto* pChild = (Variable*)lua_touserdata(L, 2);
 
-	(*pVar)->children.push_back(*pChild);
+	pVar->AddChild(*pChild);
 	return 0;
 }
 
 int metaIndex(lua_State* L)
 {
-	auto* pVar = (Idx<Variable>*)lua_touserdata(L, 1);
+	auto* pVar = (Variable*)lua_touserdata(L, 1);
 	auto var = *pVar;
 	const std::string k = lua_tostring(L, 2);
 	if (k == "name")
 	{
-		lua_pushstring(L, var->name.c_str());
+		lua_pushstring(L, var.GetName());
 	}
 	else if (k == "value")
 	{
-		lua_pushstring(L, var->value.c_str());
+		lua_pushstring(L, var.GetValue());
 	}
 	else if (k == "valueType")
 	{
-		lua_pushnumber(L, var->valueType);
+		lua_pushnumber(L, var.GetValueType());
 	}
 	else if (k == "valueTypeName")
 	{
-		lua_pushstring(L, var->valueTypeName.c_str());
+		lua_pushstring(L, var.GetValueTypeName());
 	}
 	else if (k == "addChild")
 	{
@@ -70,34 +70,34 @@ int metaIndex(lua_State* L)
 
 int metaNewIndex(lua_State* L)
 {
-	auto* pVar = (Idx<Variable>*)lua_touserdata(L, 1);
+	auto* pVar = (Variable*)lua_touserdata(L, 1);
 	auto var = *pVar;
 	const std::string k = lua_tostring(L, 2);
 	if (k == "name")
 	{
 		const char* value = lua_tostring(L, 3);
-		var->name = value ? value : "";
+		var.SetName(value ? value : "");
 	}
 	else if (k == "value")
 	{
 		const char* value = lua_tostring(L, 3);
-		var->value = value ? value : "";
+		var.SetValue(value ? value : "");
 	}
 	else if (k == "valueType")
 	{
-		var->valueType = static_cast<int>(lua_tonumber(L, 3));
+		var.SetValueType(static_cast<int>(lua_tonumber(L, 3)));
 	}
 	else if (k == "valueTypeName")
 	{
 		const char* value = lua_tostring(L, 3);
-		var->valueTypeName = value ? value : "";
+		var.SetValueTypeName(value ? value : "");
 	}
 	return 0;
 }
 
-void pushVariable(lua_State* L, Idx<Variable> variable)
+void pushVariable(lua_State* L, Variable variable)
 {
-	auto p = (Idx<Variable>*)lua_newuserdata(L, sizeof(Idx<Variable>));
+	auto p = (Variable*)lua_newuserdata(L, sizeof(Variable));
 	*p = variable;
 	lua_pushstring(L, "EMMY_META");
 	lua_rawget(L, LUA_REGISTRYINDEX);
@@ -157,7 +157,7 @@ void ExtensionPoint::Initialize(lua_State* L)
 	lua_rawset(L, LUA_REGISTRYINDEX);
 }
 
-bool ExtensionPoint::QueryVariableGeneric(lua_State* L, Idx<Variable> variable, const char* typeName, int object,
+bool ExtensionPoint::QueryVariableGeneric(lua_State* L, Variable variable, const char* typeName, int object,
                                           int depth, const char* queryFunction)
 {
 	bool result = false;
@@ -191,12 +191,12 @@ bool ExtensionPoint::QueryVariableGeneric(lua_State* L, Idx<Variable> variable,
 	return result;
 }
 
-bool ExtensionPoint::QueryVariable(lua_State* L, Idx<Variable> variable, const char* typeName, int object, int depth)
+bool ExtensionPoint::QueryVariable(lua_State* L, Variable variable, const char* typeName, int object, int depth)
 {
 	return QueryVariableGeneric(L, variable, typeName, object, depth, "queryVariable");
 }
 
-bool ExtensionPoint::QueryVariableCustom(lua_State* L, Idx<Variable> variable, const char* typeName, int object,
+bool ExtensionPoint::QueryVariableCustom(lua_State* L, Variable variable, const char* typeName, int object,
                                          int depth)
 {
 	return QueryVariableGeneric(L, variable, typeName, object, depth, "queryVariableCustom");
@@ -0,0 +1,77 @@
+#include "emmy_debugger/debugger/hit_condition.h"
+#include <cctype>
+
+HitCondition::HitCondition(const std::string &hitCondition)
+	: op(Operator::Never), hitTimes(0) {
+	std::size_t index = 0;
+	const auto size = hitCondition.size();
+	auto skipSpace = [&]() {
+		while (index < size && hitCondition[index] == ' ') {
+			index++;
+		}
+	};
+	auto match = [&](const char *token) {
+		const auto len = std::char_traits<char>::length(token);
+		if (hitCondition.compare(index, len, token) != 0) {
+			return false;
+		}
+		index += len;
+		return true;
+	};
+
+	skipSpace();
+	Operator parsed;
+	if (match("==")) {
+		parsed = Operator::Eq;
+	} else if (match(">=")) {
+		parsed = Operator::GtEq;
+	} else if (match("<=")) {
+		parsed = Operator::LtEq;
+	} else if (match(">")) {
+		parsed = Operator::Gt;
+	} else if (match("<")) {
+		parsed = Operator::Lt;
+	} else if (match("%")) {
+		parsed = Operator::Mod;
+	} else {
+		return;
+	}
+
+	skipSpace();
+	const auto digitsBegin = index;
+	uint64_t times = 0;
+	while (index < size && isdigit(static_cast<unsigned char>(hitCondition[index]))) {
+		times = times * 10 + (hitCondition[index] - '0');
+		index++;
+	}
+	if (index == digitsBegin) {
+		return;
+	}
+	skipSpace();
+	if (index != size || (parsed == Operator::Mod && times == 0)) {
+		return;
+	}
+
+	op = parsed;
+	hitTimes = times;
+}
+
+bool HitCondition::Check(uint64_t hitCount) const {
+	switch (op) {
+		case Operator::Eq:
+			return hitCount == hitTimes;
+		case Operator::Gt:
+			return hitCount > hitTimes;
+		case Operator::GtEq:
+			return hitCount >= hitTimes;
+		case Operator::Lt:
+			return hitCount < hitTimes;
+		case Operator::LtEq:
+			return hitCount <= hitTimes;
+		case Operator::Mod:
+			return hitCount % hitTimes == 0;
+		case Operator::Never:
+			break;
+	}
+	return false;
+}
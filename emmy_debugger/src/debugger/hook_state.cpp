@@ -16,8 +16,38 @@
 #include "emmy_debugger/debugger/hook_state.h"
 #include "emmy_debugger/debugger/emmy_debugger.h"
 #include "emmy_debugger/api/lua_api.h"
+#include "emmy_debugger/api/lua_version.h"
+#include "emmy_debugger/api/lua_state.h"
 #include "emmy_debugger/emmy_facade.h"
 
+namespace
+{
+	// coroutine.yield 的标识, 沿 _LOADED 用 rawget 查找, 不会执行 lua 代码
+	const void* FindYieldFunction(lua_State* L)
+	{
+		const int top = lua_gettop(L);
+		const void* identity = nullptr;
+		lua_pushstring(L, "_LOADED");
+		lua_rawget(L, LUA_REGISTRYINDEX);
+		if (lua_istable(L, -1))
+		{
+			lua_pushstring(L, "coroutine");
+			lua_rawget(L, -2);
+			if (lua_istable(L, -1))
+			{
+				lua_pushstring(L, "yield");
+				lua_rawget(L, -2);
+				if (lua_isfunction(L, -1))
+				{
+					identity = lua_topointer(L, -1);
+				}
+			}
+		}
+		lua_settop(L, top);
+		return identity;
+	}
+}
+
 HookState::HookState():
 	currentStateL(nullptr)
 {
@@ -29,55 +59,140 @@ bool HookState::Start(std::shared_ptr<Debugger> debugger, lua_State* current)
 	return true;
 }
 
-void HookState::ProcessHook(std::shared_ptr<Debugger> debugger, lua_State* L, lua_Debug* ar)
+void HookState::ProcessHook(Debugger*, lua_State*, lua_Debug*)
 {
 }
 
+int HookState::GetHookMask(lua_State*)
+{
+	return LUA_MASKLINE;
+}
+
 bool HookStateContinue::Start(std::shared_ptr<Debugger> debugger, lua_State* current)
 {
 	debugger->ExitDebugMode();
 	return true;
 }
 
+int HookStateContinue::GetHookMask(lua_State*)
+{
+	// 只有断点需要行事件，由debugger 根据断点决定
+	return 0;
+}
+
 bool StackLevelBasedState::Start(std::shared_ptr<Debugger> debugger, lua_State* current)
 {
 	if (current == nullptr)
 		return false;
 	currentStateL = current;
-	oriStackLevel = newStackLevel = debugger->GetStackLevel(false);
+	ResetStackLevel(current);
+	oriStackLevel = newStackLevel;
 	return true;
 }
 
-void StackLevelBasedState::UpdateStackLevel(std::shared_ptr<Debugger> debugger, lua_State* L, lua_Debug* ar)
+int StackLevelBasedState::GetHookMask(lua_State*)
+{
+	return LUA_MASKLINE | LUA_MASKCALL | LUA_MASKRET;
+}
+
+void StackLevelBasedState::UpdateStackLevel(Debugger*, lua_State* L, lua_Debug* ar)
 {
 	if (L != currentStateL)
 	{
 		return;
 	}
-	// this is needed to check if the stack got shorter or longer.
-	// unfortunately counting call/return calls is not reliable.
-	// the discrepancy may happen when "pcall(load, '')" call is made
-	// or when "error()" is called in a function.
-	// in either case there are more "call" than "return" events reported.
-	// this validation is done for every "line" event, but should be "cheap"
-	// as it checks for the stack to get shorter (or longer by one call).
-	// start from one level higher just in case we need to grow the stack.
-	// this may happen after coroutine.resume call to a function that doesn't
-	// have any other instructions to execute. it triggers three returns:
-	// "return, tail return, return", which needs to be accounted for.
-
-	newStackLevel = debugger->GetStackLevel(false);
-
-	// "cheap" version
-	// lua_Debug ar2{};
-	// for (int i = newStackLevel + 1; i >= 0; --i)
-	// {
-	// 	if (lua_getstack(L, i, &ar2))
-	// 	{
-	// 		newStackLevel = i + 1;
-	// 		break;
-	// 	}
-	// }
+	// 深度由 call/return 事件增量计算, 每个事件的开销与栈深度无关
+	// call/return 并不总是成对出现, error 展开栈时不会产生return 事件,
+	// 所以每个事件都用当前帧的标识校验栈顶, 不一致时弹出已经不存在的帧
+	// 5.2 以后的 tail call 复用调用者的帧, 5.1 的 tail call 在下一次事件中折叠
+	const intptr_t callInfo = GetCurrentCallInfo(L);
+	const int event = getDebugEvent(ar);
+
+	if (callInfo == 0)
+	{
+		// 无法识别帧时只计数, 并定期用 lua_getstack 校验
+		if (event == LUA_HOOKCALL)
+		{
+			callInfos.push_back(0);
+		}
+		else if (event == LUA_HOOKRET && !callInfos.empty())
+		{
+			callInfos.pop_back();
+		}
+		else if (event == LUA_HOOKLINE && --validateCountdown <= 0)
+		{
+			validateCountdown = 64;
+			const int depth = static_cast<int>(callInfos.size());
+			lua_Debug probe{};
+			if (depth == 0 || !lua_getstack(L, depth - 1, &probe) || lua_getstack(L, depth, &probe))
+			{
+				ResetStackLevel(L);
+			}
+		}
+		newStackLevel = static_cast<int>(callInfos.size());
+		return;
+	}
+
+	switch (event)
+	{
+	case LUA_HOOKCALL:
+		callInfos.push_back(callInfo);
+		break;
+	case LUA_HOOKRET:
+		if (PopToCallInfo(callInfo))
+		{
+			callInfos.pop_back();
+		}
+		else
+		{
+			ResetStackLevel(L);
+			// 返回事件中当前帧还在栈上
+			if (!callInfos.empty())
+			{
+				callInfos.pop_back();
+			}
+		}
+		break;
+	case LUA_HOOKLINE:
+	case LUA_HOOKCOUNT:
+		if (!PopToCallInfo(callInfo))
+		{
+			ResetStackLevel(L);
+		}
+		break;
+	default:
+		// tail call/tail return 不改变帧
+		break;
+	}
+	newStackLevel = static_cast<int>(callInfos.size());
+}
+
+void StackLevelBasedState::ResetStackLevel(lua_State* L)
+{
+	callInfos = GetCallInfos(L);
+	if (luaVersion == LuaVersion::LUA_JIT)
+	{
+		lua_Debug ar{};
+		for (int level = 0; lua_getstack(L, level, &ar); level++)
+		{
+			callInfos.push_back(0);
+		}
+	}
+	newStackLevel = static_cast<int>(callInfos.size());
+	validateCountdown = 64;
+}
+
+bool StackLevelBasedState::PopToCallInfo(intptr_t callInfo)
+{
+	for (auto i = callInfos.size(); i > 0; i--)
+	{
+		if (callInfos[i - 1] == callInfo)
+		{
+			callInfos.resize(i);
+			return true;
+		}
+	}
+	return false;
 }
 
 bool HookStateStepIn::Start(std::shared_ptr<Debugger> debugger, lua_State* current)
@@ -93,9 +208,8 @@ bool HookStateStepIn::Start(std::shared_ptr<Debugger> debugger, lua_State* curre
 	return true;
 }
 
-void HookStateStepIn::ProcessHook(std::shared_ptr<Debugger> debugger, lua_State* L, lua_Debug* ar)
+void HookStateStepIn::ProcessHook(Debugger* debugger, lua_State* L, lua_Debug* ar)
 {
-	UpdateStackLevel(debugger, L, ar);
 	if (getDebugEvent(ar) == LUA_HOOKLINE)
 	{
 		lua_getinfo(L, "nSl", ar);
@@ -111,6 +225,11 @@ void HookStateStepIn::ProcessHook(std::shared_ptr<Debugger> debugger, lua_State*
 	StackLevelBasedState::ProcessHook(debugger, L, ar);
 }
 
+int HookStateStepIn::GetHookMask(lua_State*)
+{
+	return LUA_MASKLINE;
+}
+
 bool HookStateStepOut::Start(std::shared_ptr<Debugger> debugger, lua_State* current)
 {
 	if (!StackLevelBasedState::Start(debugger, current))
@@ -119,10 +238,11 @@ bool HookStateStepOut::Start(std::shared_ptr<Debugger> debugger, lua_State* curr
 	return true;
 }
 
-void HookStateStepOut::ProcessHook(std::shared_ptr<Debugger> debugger, lua_State* L, lua_Debug* ar)
+void HookStateStepOut::ProcessHook(Debugger* debugger, lua_State* L, lua_Debug* ar)
 {
 	UpdateStackLevel(debugger, L, ar);
-	if (newStackLevel < oriStackLevel)
+	// 只在行事件中断, call/return 事件中栈帧还未稳定
+	if (getDebugEvent(ar) == LUA_HOOKLINE && newStackLevel < oriStackLevel)
 	{
 		debugger->HandleBreak();
 		return;
@@ -139,13 +259,57 @@ bool HookStateStepOver::Start(std::shared_ptr<Debugger> debugger, lua_State* cur
 	lua_getinfo(current, "nSl", &ar);
 	file = getDebugSource(&ar);
 	line = getDebugCurrentLine(&ar);
+	inCallee = false;
+	calleeYields = false;
+	yieldFunction = FindYieldFunction(current);
 	debugger->ExitDebugMode();
 	return true;
 }
 
-void HookStateStepOver::ProcessHook(std::shared_ptr<Debugger> debugger, lua_State* L, lua_Debug* ar)
+void HookStateStepOver::ProcessHook(Debugger* debugger, lua_State* L, lua_Debug* ar)
 {
+	if (L != currentStateL)
+	{
+		// 被调用的函数 resume 了其他协程, 它的事件不影响单步, 之后由 currentStateL 的 return 事件继续
+		if (inCallee && !calleeYields)
+		{
+			return;
+		}
+		// 当前函数返回或 yield 后回到了 resume 它的协程, currentStateL 不一定还会继续执行
+		// 清掉 inCallee 并在这个协程的下一行中断
+		if (inCallee)
+		{
+			inCallee = false;
+			debugger->InvalidateHookMask();
+		}
+		if (getDebugEvent(ar) == LUA_HOOKLINE)
+		{
+			debugger->HandleBreak();
+		}
+		return;
+	}
+
 	UpdateStackLevel(debugger, L, ar);
+	// 进入被调用的函数时关闭行事件, 返回到原来的深度时再打开
+	// 当前事件的hook mask 已经设置过了, 所以切换后需要立即对 L 重新设置
+	const bool deeper = newStackLevel > oriStackLevel;
+	if (deeper != inCallee)
+	{
+		if (deeper && getDebugEvent(ar) == LUA_HOOKCALL)
+		{
+			lua_getinfo(L, "f", ar);
+			calleeYields = yieldFunction != nullptr && lua_topointer(L, -1) == yieldFunction;
+			lua_pop(L, 1);
+		}
+		inCallee = deeper;
+		debugger->InvalidateHookMask();
+		debugger->UpdateHookMask(L, ar);
+	}
+
+	if (getDebugEvent(ar) != LUA_HOOKLINE)
+	{
+		return;
+	}
 	// step out
 	if (newStackLevel < oriStackLevel)
 	{
@@ -169,7 +333,17 @@ void HookStateStepOver::ProcessHook(std::shared_ptr<Debugger> debugger, lua_Stat
 	StackLevelBasedState::ProcessHook(debugger, L, ar);
 }
 
-void HookStateBreak::ProcessHook(std::shared_ptr<Debugger> debugger, lua_State* L, lua_Debug* ar)
+int HookStateStepOver::GetHookMask(lua_State* L)
+{
+	// yield 之后控制权回到其他协程, 它们需要行事件
+	if (inCallee && (L == currentStateL || !calleeYields))
+	{
+		return LUA_MASKCALL | LUA_MASKRET;
+	}
+	return StackLevelBasedState::GetHookMask(L);
+}
+
+void HookStateBreak::ProcessHook(Debugger* debugger, lua_State* L, lua_Debug* ar)
 {
 	if (getDebugEvent(ar) == LUA_HOOKLINE)
 	{
@@ -197,3 +371,8 @@ bool HookStateStop::Start(std::shared_ptr<Debugger> debugger, lua_State* current
 
 	return true;
 }
+
+int HookStateStop::GetHookMask(lua_State*)
+{
+	return 0;
+}
@@ -0,0 +1,150 @@
+#include "emmy_debugger/debugger/log_template.h"
+
+namespace {
+struct LogMessageReplaceExpress {
+public:
+	LogMessageReplaceExpress(std::string &&expr, std::size_t startIndex, std::size_t endIndex, bool needEval)
+		: Expr(expr),
+		  StartIndex(startIndex),
+		  EndIndex(endIndex),
+		  NeedEval(needEval) {
+	}
+
+	std::string Expr;
+	std::size_t StartIndex;
+	std::size_t EndIndex;
+	bool NeedEval;
+};
+
+std::string BaseName(const std::string &filePath) {
+	std::size_t sepIndex = filePath.find_last_of('/');
+	if (sepIndex == std::string::npos) {
+		sepIndex = filePath.find_last_of('\\');
+		if (sepIndex != std::string::npos) {
+			return filePath.substr(sepIndex + 1);
+		}
+		return filePath;
+	} else {
+		return filePath.substr(sepIndex + 1);
+	}
+}
+}
+
+LogTemplate::LogTemplate(const std::string &file, int line, const std::string &logMessage)
+	: literalSize(0) {
+	prefix = "[" + BaseName(file) + ":" + std::to_string(line) + "] ";
+	literalSize = prefix.size();
+
+	// 为什么不用regex?
+	// 因为gcc 4.8 regex还是空实现
+	// 而且后续版本的gcc中正则表达式行为似乎也不太正常
+	enum class ParseState {
+		Normal,
+		LeftBrace,
+		RightBrace
+	} state = ParseState::Normal;
+
+	std::vector<LogMessageReplaceExpress> replaceExpresses;
+
+	std::size_t leftBraceBegin = 0;
+
+	std::size_t rightBraceBegin = 0;
+
+	// 如果在表达式中出现左大括号
+	std::size_t exprLeftCount = 0;
+
+	for (std::size_t index = 0; index != logMessage.size(); index++) {
+		char ch = logMessage[index];
+
+		switch (state) {
+			case ParseState::Normal: {
+				if (ch == '{') {
+					state = ParseState::LeftBrace;
+					leftBraceBegin = index;
+					exprLeftCount = 0;
+				} else if (ch == '}') {
+					state = ParseState::RightBrace;
+					rightBraceBegin = index;
+				}
+				break;
+			}
+			case ParseState::LeftBrace: {
+				if (ch == '{') {
+					// 认为是左双大括号转义为可见的'{'
+					if (index == leftBraceBegin + 1) {
+						replaceExpresses.emplace_back("{", leftBraceBegin, index, false);
+						state = ParseState::Normal;
+					} else {
+						exprLeftCount++;
+					}
+				} else if (ch == '}') {
+					// 认为是表达式内的大括号
+					if (exprLeftCount > 0) {
+						exprLeftCount--;
+						continue;
+					}
+
+					replaceExpresses.emplace_back(logMessage.substr(leftBraceBegin + 1, index - leftBraceBegin - 1),
+					                              leftBraceBegin, index, true);
+
+					state = ParseState::Normal;
+				}
+				break;
+			}
+			case ParseState::RightBrace: {
+				if (ch == '}' && (index == rightBraceBegin + 1)) {
+					replaceExpresses.emplace_back("}", rightBraceBegin, index, false);
+				} else {
+					//认为左右大括号失配，之前的不做处理，退格一位回去重新判断
+					index--;
+				}
+				state = ParseState::Normal;
+				break;
+			}
+		}
+	}
+
+	std::size_t start = 0;
+	for (auto &replaceExpress: replaceExpresses) {
+		if (start < replaceExpress.StartIndex) {
+			AppendLiteral(logMessage, start, replaceExpress.StartIndex);
+			start = replaceExpress.StartIndex;
+		}
+
+		if (replaceExpress.NeedEval) {
+			Segment segment;
+			segment.text = std::move(replaceExpress.Expr);
+			segment.isExpr = true;
+			segments.push_back(std::move(segment));
+		} else {
+			AppendLiteral(replaceExpress.Expr, 0, replaceExpress.Expr.size());
+		}
+
+		start = replaceExpress.EndIndex + 1;
+	}
+
+	if (start < logMessage.size()) {
+		AppendLiteral(logMessage, start, logMessage.size());
+	}
+}
+
+const std::string &LogTemplate::GetPrefix() const {
+	return prefix;
+}
+
+const std::vector<LogTemplate::Segment> &LogTemplate::GetSegments() const {
+	return segments;
+}
+
+std::size_t LogTemplate::GetLiteralSize() const {
+	return literalSize;
+}
+
+void LogTemplate::AppendLiteral(const std::string &logMessage, std::size_t start, std::size_t end) {
+	// 相邻的字面量合并成一段
+	if (segments.empty() || segments.back().isExpr) {
+		segments.emplace_back();
+	}
+	segments.back().text.append(logMessage, start, end - start);
+	literalSize += end - start;
+}
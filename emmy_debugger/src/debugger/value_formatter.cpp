@@ -0,0 +1,82 @@
+#include "emmy_debugger/debugger/value_formatter.h"
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+ValueFormatter::ValueFormatter()
+	: _size(0) {
+	_buffer[0] = '\0';
+}
+
+ValueFormatter &ValueFormatter::Append(const char *str) {
+	return Append(str, strlen(str));
+}
+
+ValueFormatter &ValueFormatter::Append(const char *str, std::size_t size) {
+	// 保留结尾的 '\0'
+	const std::size_t room = Capacity - 1 - _size;
+	if (size > room) {
+		size = room;
+	}
+	memcpy(_buffer + _size, str, size);
+	_size += size;
+	_buffer[_size] = '\0';
+	return *this;
+}
+
+ValueFormatter &ValueFormatter::AppendInteger(int64_t value) {
+	if (value < 0) {
+		Append("-", 1);
+		// 先加 1 再取反, INT64_MIN 也不会溢出
+		return AppendUnsigned(static_cast<uint64_t>(-(value + 1)) + 1);
+	}
+	return AppendUnsigned(static_cast<uint64_t>(value));
+}
+
+ValueFormatter &ValueFormatter::AppendUnsigned(uint64_t value) {
+	char digits[20];
+	std::size_t n = 0;
+	do {
+		digits[sizeof(digits) - ++n] = static_cast<char>('0' + value % 10);
+		value /= 10;
+	} while (value != 0);
+	return Append(digits + sizeof(digits) - n, n);
+}
+
+ValueFormatter &ValueFormatter::AppendNumber(double value) {
+	// [-2^63, 2^63) 内的整数值, 超出 int64_t 的交给 %.14g
+	if (std::floor(value) == value && value >= -9223372036854775808.0 && value < 9223372036854775808.0) {
+		return AppendInteger(static_cast<int64_t>(value));
+	}
+	if (std::isnan(value)) {
+		return Append(std::signbit(value) ? "-nan" : "nan");
+	}
+	if (std::isinf(value)) {
+		return Append(value < 0 ? "-inf" : "inf");
+	}
+	char text[32];
+	const int size = snprintf(text, sizeof(text), "%.14g", value);
+	if (size <= 0) {
+		return *this;
+	}
+	// 小数点可能受 locale 影响
+	for (int i = 0; i < size; i++) {
+		if (text[i] != '-' && text[i] != '+' && text[i] != 'e' && (text[i] < '0' || text[i] > '9')) {
+			text[i] = '.';
+		}
+	}
+	return Append(text, static_cast<std::size_t>(size) < sizeof(text) ? size : sizeof(text) - 1);
+}
+
+ValueFormatter &ValueFormatter::AppendPointer(const void *pointer) {
+	static const char hex[] = "0123456789abcdef";
+	auto value = reinterpret_cast<uintptr_t>(pointer);
+	char digits[2 * sizeof(uintptr_t)];
+	std::size_t n = 0;
+	do {
+		digits[sizeof(digits) - ++n] = hex[value & 0xf];
+		value >>= 4;
+	} while (value != 0);
+	Append("0x", 2);
+	return Append(digits + sizeof(digits) - n, n);
+}
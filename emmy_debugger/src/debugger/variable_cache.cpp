@@ -0,0 +1,130 @@
+#include "emmy_debugger/debugger/variable_cache.h"
+
+#define CACHE_TABLE_NAME "_emmy_cache_table_"
+
+VariableCache::VariableCache()
+	: _epoch(1),
+	  _lastSize(0) {
+	_slots.push_back(Slot{0, false});
+}
+
+int64_t VariableCache::Store(lua_State *L, int valueIndex, bool weak) {
+	valueIndex = lua_absindex(L, valueIndex);
+	uint32_t slot = 0;
+	if (!_freeSlots.empty()) {
+		slot = _freeSlots.back();
+		_freeSlots.pop_back();
+		// 重用的槽位换一个代数, 之前的 cacheId 不再匹配
+		_slots[slot].generation++;
+	} else if (_slots.size() <= SlotMask) {
+		slot = static_cast<uint32_t>(_slots.size());
+		_slots.push_back(Slot{1, false});
+	} else {
+		return 0;
+	}
+	_slots[slot].used = true;
+
+	PushTable(L, true, weak);
+	lua_pushvalue(L, valueIndex);
+	lua_rawseti(L, -2, static_cast<int>(slot));
+	lua_pop(L, 1);
+	return static_cast<int64_t>(_epoch) << (SlotBits + GenerationBits)
+	       | static_cast<int64_t>(_slots[slot].generation) << SlotBits
+	       | slot;
+}
+
+bool VariableCache::Replace(lua_State *L, int64_t cacheId, int valueIndex) {
+	const uint32_t slot = Find(cacheId);
+	valueIndex = lua_absindex(L, valueIndex);
+	if (slot == 0 || !PushTable(L, false, false)) {
+		return false;
+	}
+	lua_pushvalue(L, valueIndex);
+	lua_rawseti(L, -2, static_cast<int>(slot));
+	lua_pop(L, 1);
+	return true;
+}
+
+bool VariableCache::Push(lua_State *L, int64_t cacheId) {
+	const uint32_t slot = Find(cacheId);
+	if (slot == 0 || !PushTable(L, false, false)) {
+		return false;
+	}
+	lua_rawgeti(L, -1, static_cast<int>(slot));
+	lua_remove(L, -2);
+	if (lua_isnil(L, -1)) {
+		// weak 模式下已被回收
+		lua_pop(L, 1);
+		Release(L, cacheId);
+		return false;
+	}
+	return true;
+}
+
+void VariableCache::Release(lua_State *L, int64_t cacheId) {
+	const uint32_t slot = Find(cacheId);
+	if (slot == 0) {
+		return;
+	}
+	_slots[slot].used = false;
+	// 代数用完的槽位不再重用, 本次中断内它的 cacheId 都保持无效
+	if (_slots[slot].generation < GenerationMask) {
+		_freeSlots.push_back(slot);
+	}
+	if (PushTable(L, false, false)) {
+		lua_pushnil(L);
+		lua_rawseti(L, -2, static_cast<int>(slot));
+		lua_pop(L, 1);
+	}
+}
+
+void VariableCache::Clear(lua_State *L) {
+	lua_getfield(L, LUA_REGISTRYINDEX, CACHE_TABLE_NAME);
+	if (!lua_isnil(L, -1)) {
+		lua_pushnil(L);
+		lua_setfield(L, LUA_REGISTRYINDEX, CACHE_TABLE_NAME);
+	}
+	lua_pop(L, 1);
+
+	if (_slots.size() > 1) {
+		_lastSize = static_cast<int>(_slots.size()) - 1;
+		_slots.resize(1);
+		_freeSlots.clear();
+		_epoch = _epoch % EpochMask + 1;
+	}
+}
+
+uint32_t VariableCache::Find(int64_t cacheId) const {
+	if (cacheId <= 0) {
+		return 0;
+	}
+	const auto slot = static_cast<uint32_t>(cacheId & SlotMask);
+	const auto generation = static_cast<uint32_t>(cacheId >> SlotBits & GenerationMask);
+	const auto epoch = static_cast<uint64_t>(cacheId) >> (SlotBits + GenerationBits);
+	if (epoch != _epoch || slot == 0 || slot >= _slots.size()
+		|| !_slots[slot].used || _slots[slot].generation != generation) {
+		return 0;
+	}
+	return slot;
+}
+
+bool VariableCache::PushTable(lua_State *L, bool create, bool weak) {
+	lua_getfield(L, LUA_REGISTRYINDEX, CACHE_TABLE_NAME);
+	if (lua_type(L, -1) == LUA_TTABLE) {
+		return true;
+	}
+	lua_pop(L, 1);
+	if (!create) {
+		return false;
+	}
+	lua_createtable(L, _lastSize, 0);
+	if (weak) {
+		lua_createtable(L, 0, 1);
+		lua_pushstring(L, "v");
+		lua_setfield(L, -2, "__mode");
+		lua_setmetatable(L, -2);
+	}
+	lua_pushvalue(L, -1);
+	lua_setfield(L, LUA_REGISTRYINDEX, CACHE_TABLE_NAME);
+	return true;
+}
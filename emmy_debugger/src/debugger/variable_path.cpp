@@ -0,0 +1,242 @@
+#include "emmy_debugger/debugger/variable_path.h"
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+void SkipSpace(const std::string &text, std::size_t &pos) {
+	while (pos < text.size() && std::isspace(static_cast<unsigned char>(text[pos]))) {
+		pos++;
+	}
+}
+
+bool ParseName(const std::string &text, std::size_t &pos, std::string &name) {
+	if (pos >= text.size()) {
+		return false;
+	}
+	const char c = text[pos];
+	if (!std::isalpha(static_cast<unsigned char>(c)) && c != '_') {
+		return false;
+	}
+	const auto start = pos;
+	while (pos < text.size() && (std::isalnum(static_cast<unsigned char>(text[pos])) || text[pos] == '_')) {
+		pos++;
+	}
+	name = text.substr(start, pos - start);
+	return !VariablePath::IsKeyword(name);
+}
+
+// 不含转义和换行的字符串
+bool ParseString(const std::string &text, std::size_t &pos, std::string &str) {
+	const char quote = text[pos++];
+	const auto start = pos;
+	while (pos < text.size() && text[pos] != quote) {
+		if (text[pos] == '\\' || text[pos] == '\n' || text[pos] == '\r') {
+			return false;
+		}
+		pos++;
+	}
+	if (pos >= text.size()) {
+		return false;
+	}
+	str = text.substr(start, pos - start);
+	pos++;
+	return true;
+}
+}
+
+bool VariablePath::Parse(const std::string &text, VariablePath &path) {
+	std::size_t pos = 0;
+	SkipSpace(text, pos);
+	if (!Parse(text, pos, path)) {
+		return false;
+	}
+	SkipSpace(text, pos);
+	return pos == text.size();
+}
+
+bool VariablePath::Parse(const std::string &text, std::size_t &pos, VariablePath &path) {
+	path.keys.clear();
+	Key key;
+	if (!ParseName(text, pos, key.name)) {
+		return false;
+	}
+	path.keys.push_back(std::move(key));
+
+	while (true) {
+		auto next = pos;
+		SkipSpace(text, next);
+		if (next < text.size() && text[next] == '.') {
+			next++;
+			SkipSpace(text, next);
+			Key field;
+			if (!ParseName(text, next, field.name)) {
+				return false;
+			}
+			path.keys.push_back(std::move(field));
+		} else if (next < text.size() && text[next] == '[') {
+			next++;
+			SkipSpace(text, next);
+			Key field;
+			if (next < text.size() && (text[next] == '"' || text[next] == '\'')) {
+				if (!ParseString(text, next, field.name) || field.name.empty()) {
+					return false;
+				}
+			} else {
+				// 只支持整数下标, 浮点数和负数下标交给lua
+				const auto start = next;
+				while (next < text.size() && std::isdigit(static_cast<unsigned char>(text[next]))) {
+					next++;
+				}
+				if (next == start || next - start > 9) {
+					return false;
+				}
+				field.index = std::atoi(text.substr(start, next - start).c_str());
+				if (field.index <= 0) {
+					return false;
+				}
+			}
+			SkipSpace(text, next);
+			if (next >= text.size() || text[next] != ']') {
+				return false;
+			}
+			next++;
+			path.keys.push_back(std::move(field));
+		} else {
+			break;
+		}
+		pos = next;
+	}
+	return true;
+}
+
+bool VariablePath::IsKeyword(const std::string &name) {
+	static const char *keywords[] = {
+		"and", "break", "do", "else", "elseif", "end", "false", "for", "function", "goto", "if", "in",
+		"local", "nil", "not", "or", "repeat", "return", "then", "true", "until", "while"
+	};
+	for (auto keyword: keywords) {
+		if (name == keyword) {
+			return true;
+		}
+	}
+	return false;
+}
+
+bool VariablePath::Push(lua_State *L, lua_Debug *ar) const {
+	if (keys.empty()) {
+		return false;
+	}
+	const int top = lua_gettop(L);
+	if (!PushVariable(L, ar, keys[0].name)) {
+		return false;
+	}
+	for (std::size_t i = 1; i < keys.size(); i++) {
+		// 非表的字段访问可能走元方法或报错
+		if (lua_type(L, -1) != LUA_TTABLE) {
+			lua_settop(L, top);
+			return false;
+		}
+		const auto &key = keys[i];
+		if (key.name.empty()) {
+			lua_rawgeti(L, -1, key.index);
+		} else {
+			lua_pushlstring(L, key.name.c_str(), key.name.size());
+			lua_rawget(L, -2);
+		}
+		// 可能由 __index 提供
+		if (lua_type(L, -1) == LUA_TNIL && lua_getmetatable(L, -2)) {
+			lua_settop(L, top);
+			return false;
+		}
+		lua_remove(L, -2);
+	}
+	return true;
+}
+
+// 与 EnvIndexFunction 相同的顺序, 同名的取最后一个, 值为 nil 时继续往下找
+bool VariablePath::PushVariable(lua_State *L, lua_Debug *ar, const std::string &name) {
+	const int top = lua_gettop(L);
+	int envUpvalue = 0;
+	// up value
+	if (lua_getinfo(L, "f", ar)) {
+		const int function = lua_gettop(L);
+		int found = 0;
+		for (int i = 1;; i++) {
+			const char *upvalueName = lua_getupvalue(L, function, i);
+			if (upvalueName == nullptr) {
+				break;
+			}
+			lua_pop(L, 1);
+			if (name == upvalueName) {
+				found = i;
+			}
+			if (strcmp(upvalueName, "_ENV") == 0) {
+				envUpvalue = i;
+			}
+		}
+		if (found > 0) {
+			lua_getupvalue(L, function, found);
+			if (lua_type(L, -1) != LUA_TNIL) {
+				lua_insert(L, top + 1);
+				lua_settop(L, top + 1);
+				return true;
+			}
+			lua_pop(L, 1);
+		}
+	}
+
+	// local value
+	int found = 0;
+	for (int i = 1;; i++) {
+		const char *localName = lua_getlocal(L, ar, i);
+		if (localName == nullptr) {
+			break;
+		}
+		lua_pop(L, 1);
+		if (name == localName) {
+			found = i;
+		}
+	}
+	if (found > 0) {
+		lua_getlocal(L, ar, found);
+		if (lua_type(L, -1) != LUA_TNIL) {
+			lua_insert(L, top + 1);
+			lua_settop(L, top + 1);
+			return true;
+		}
+		lua_pop(L, 1);
+	}
+
+	// _ENV
+	if (envUpvalue > 0) {
+		lua_getupvalue(L, top + 1, envUpvalue);
+		if (lua_type(L, -1) == LUA_TTABLE) {
+			lua_pushlstring(L, name.c_str(), name.size());
+			lua_rawget(L, -2);
+			if (lua_type(L, -1) != LUA_TNIL) {
+				lua_insert(L, top + 1);
+				lua_settop(L, top + 1);
+				return true;
+			}
+			if (lua_getmetatable(L, -2)) {
+				lua_settop(L, top);
+				return false;
+			}
+			lua_pop(L, 1);
+		}
+		lua_pop(L, 1);
+	}
+
+	// global
+	lua_pushglobaltable(L);
+	lua_pushlstring(L, name.c_str(), name.size());
+	lua_rawget(L, -2);
+	if (lua_type(L, -1) == LUA_TNIL && lua_getmetatable(L, -2)) {
+		lua_settop(L, top);
+		return false;
+	}
+	lua_insert(L, top + 1);
+	lua_settop(L, top + 1);
+	return true;
+}
@@ -42,15 +42,20 @@ void EmmyFacade::ReadyLuaHook(lua_State *L, lua_Debug *ar) {
 	}
 	Get().readyHook = false;
 
+	EmmyDebuggerManager::HookScope scope(Get()._emmyDebuggerManager);
+	auto debugger = Get().GetDebugger(L);
 	auto states = FindAllCoroutine(L);
+	states.push_back(L);
 
 	for (auto state: states) {
-		lua_sethook(state, HookLua, LUA_MASKCALL | LUA_MASKLINE | LUA_MASKRET, 0);
+		if (debugger) {
+			debugger->UpdateHook(debugger->GetHookMask(state), state);
+		}
+		else {
+			lua_sethook(state, HookLua, LUA_MASKCALL | LUA_MASKLINE | LUA_MASKRET | LUA_MASKCOUNT, Debugger::HookCount);
+		}
 	}
 
-	lua_sethook(L, HookLua, LUA_MASKCALL | LUA_MASKLINE | LUA_MASKRET, 0);
-
-	auto debugger = Get().GetDebugger(L);
 	if (debugger) {
 		debugger->Attach();
 	}
@@ -188,6 +193,7 @@ int EmmyFacade::BreakHere(lua_State *L) {
 	if (!isIDEReady)
 		return 0;
 
+	EmmyDebuggerManager::HookScope scope(_emmyDebuggerManager);
 	_emmyDebuggerManager.HandleBreak(L);
 
 	return 1;
@@ -205,6 +211,8 @@ int EmmyFacade::OnDisconnect() {
 
 	_emmyDebuggerManager.RemoveAllBreakpoints();
 
+	_emmyDebuggerManager.SetWatches(std::vector<std::string>(), 1);
+
 	if (workMode == WorkMode::Attach) {
 		_emmyDebuggerManager.RemoveAllDebugger();
 	}
@@ -236,8 +244,14 @@ void EmmyFacade::InitReq(InitParams & params) {
 	}
 
 	_emmyDebuggerManager.helperCode = params.emmyHelper;
-	_emmyDebuggerManager.extNames.clear();
-	_emmyDebuggerManager.extNames = params.ext;
+	_emmyDebuggerManager.SetExtNames(params.ext);
+	_emmyDebuggerManager.evalInstructionLimit = params.evalInstructionLimit;
+	_emmyDebuggerManager.evalMemoryLimit = params.evalMemoryLimit;
+	_emmyDebuggerManager.lazyStacks = params.lazyStacks;
+	_emmyDebuggerManager.expandChunkSize = params.expandChunkSize;
+	_emmyDebuggerManager.expandTimeBudget = params.expandTimeBudget;
+	_emmyDebuggerManager.tableChildrenLimit = params.tableChildrenLimit;
+	_emmyDebuggerManager.weakCache = params.weakCache;
 
 	// 这里有个线程安全问题，消息线程和lua 执行线程不是相同线程，但是没有一个锁能让我做同步
 	// 所以我不能在这里访问lua state 指针的内部结构
@@ -253,6 +267,23 @@ void EmmyFacade::ReadyReq() {
 	waitIDECV.notify_all();
 }
 
+void EmmyFacade::HitCountReq() {
+	auto arr = nlohmann::json::array();
+	for (auto &bp: _emmyDebuggerManager.GetBreakpoints()) {
+		auto item = nlohmann::json::object();
+		item["file"] = bp->file;
+		item["line"] = bp->line;
+		item["hitCount"] = bp->hitCount.load(std::memory_order_relaxed);
+		arr.push_back(item);
+	}
+
+	auto obj = nlohmann::json::object();
+	obj["breakPoints"] = arr;
+	if (transporter) {
+		transporter->Send(int(MessageCMD::HitCountRsp), obj);
+	}
+}
+
 void EmmyFacade::OnReceiveMessage(nlohmann::json document) {
 	_protoHandler.OnDispatch(document);
 }
@@ -265,12 +296,19 @@ bool EmmyFacade::OnBreak(std::shared_ptr<Debugger> debugger) {
 
 	_emmyDebuggerManager.SetHitDebugger(debugger);
 
-	debugger->GetStacks(stacks);
+	debugger->GetStacks(stacks, _emmyDebuggerManager.lazyStacks);
 
 	auto obj = nlohmann::json::object();
 	obj["cmd"] = static_cast<int>(MessageCMD::BreakNotify);
 	obj["stacks"] = JsonProtocol::SerializeArray(stacks);
 
+	// 监视表达式在顶层栈帧中计算, 省去中断后逐个发送 EvalReq
+	auto watchContext = _emmyDebuggerManager.CreateWatchContext();
+	if (watchContext) {
+		debugger->BatchEval(watchContext, true);
+		obj["watches"] = watchContext->Serialize()["results"];
+	}
+
 	transporter->Send(int(MessageCMD::BreakNotify), obj);
 
 	return true;
@@ -282,6 +320,24 @@ void EmmyFacade::OnEvalResult(std::shared_ptr<EvalContext> context) {
 	}
 }
 
+void EmmyFacade::OnBatchEvalResult(std::shared_ptr<BatchEvalContext> context) {
+	if (transporter) {
+		transporter->Send(int(MessageCMD::BatchEvalRsp), context->Serialize());
+	}
+}
+
+void EmmyFacade::OnStackVariablesResult(std::shared_ptr<StackVariablesContext> context) {
+	if (transporter) {
+		transporter->Send(int(MessageCMD::StackVariablesRsp), context->Serialize());
+	}
+}
+
+void EmmyFacade::OnExpandVariableResult(std::shared_ptr<ExpandVariableContext> context) {
+	if (transporter) {
+		transporter->Send(int(MessageCMD::ExpandVariableRsp), context->Serialize());
+	}
+}
+
 void EmmyFacade::SendLog(LogType type, const char *fmt, ...) {
 	va_list args;
 	va_start(args, fmt);
@@ -289,11 +345,13 @@ void EmmyFacade::SendLog(LogType type, const char *fmt, ...) {
 	vsnprintf(buff, 1024, fmt, args);
 	va_end(args);
 
-	const std::string msg = buff;
+	SendLog(type, std::string(buff));
+}
 
+void EmmyFacade::SendLog(LogType type, const std::string &message) {
 	auto obj = nlohmann::json::object();
 	obj["type"] = type;
-	obj["message"] = msg;
+	obj["message"] = message;
 
 	if (transporter) {
 		transporter->Send(int(MessageCMD::LogNotify), obj);
@@ -315,7 +373,9 @@ void EmmyFacade::OnLuaStateGC(lua_State *L) {
 }
 
 void EmmyFacade::Hook(lua_State *L, lua_Debug *ar) {
-	auto debugger = GetDebugger(L);
+	// 热路径上不加锁也不拷贝 shared_ptr, scope 内被移除的 debugger 延迟释放
+	EmmyDebuggerManager::HookScope scope(_emmyDebuggerManager);
+	auto debugger = _emmyDebuggerManager.GetHookDebugger(L);
 	if (debugger) {
 		if (!debugger->IsRunning()) {
 			if (GetWorkMode() == WorkMode::EmmyCore) {
@@ -333,11 +393,11 @@ void EmmyFacade::Hook(lua_State *L, lua_Debug *ar) {
 		debugger->Hook(ar, L);
 	} else {
 		if (workMode == WorkMode::Attach) {
-			debugger = _emmyDebuggerManager.AddDebugger(L);
+			auto attachedDebugger = _emmyDebuggerManager.AddDebugger(L);
 			install_emmy_debugger(L);
 			if (_emmyDebuggerManager.IsRunning()) {
-				debugger->Start();
-				debugger->Attach();
+				attachedDebugger->Start();
+				attachedDebugger->Attach();
 			}
 			// send attached notify
 			auto obj = nlohmann::json::object();
@@ -345,7 +405,7 @@ void EmmyFacade::Hook(lua_State *L, lua_Debug *ar) {
 
 			this->transporter->Send(int(MessageCMD::AttachedNotify), obj);
 
-			debugger->Hook(ar, L);
+			attachedDebugger->Hook(ar, L);
 		}
 	}
 }
@@ -394,7 +454,8 @@ void EmmyFacade::Attach(lua_State *L) {
 		isAPIReady = install_emmy_debugger(L);
 	}
 
-	lua_sethook(L, EmmyFacade::HookLua, LUA_MASKCALL | LUA_MASKLINE | LUA_MASKRET, 0);
+	// 首次hook 时创建debugger, 之后按需要调整mask
+	lua_sethook(L, EmmyFacade::HookLua, LUA_MASKCOUNT, Debugger::HookCount);
 }
 
 bool EmmyFacade::RegisterTypeName(lua_State *L, const std::string &typeName, std::string &err) {
@@ -406,3 +467,12 @@ bool EmmyFacade::RegisterTypeName(lua_State *L, const std::string &typeName, std
 	const auto suc = debugger->RegisterTypeName(typeName, err);
 	return suc;
 }
+
+int EmmyFacade::Pump(lua_State *L) {
+	EmmyDebuggerManager::HookScope scope(_emmyDebuggerManager);
+	auto debugger = _emmyDebuggerManager.GetHookDebugger(L);
+	if (!debugger || !debugger->IsRunning()) {
+		return 0;
+	}
+	return debugger->Pump(L);
+}
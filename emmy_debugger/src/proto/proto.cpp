@@ -14,6 +14,7 @@
 * limitations under the License.
 */
 
+#include <cstring>
 #include <memory>
 #include "emmy_debugger/proto/proto.h"
 #include "emmy_debugger/api/lua_api.h"
@@ -44,6 +45,28 @@ void InitParams::Deserialize(nlohmann::json json) {
 			ext.emplace_back(ex);
 		}
 	}
+
+	if (json.count("evalInstructionLimit") != 0 && json["evalInstructionLimit"].is_number_integer()) {
+		evalInstructionLimit = json["evalInstructionLimit"];
+	}
+	if (json.count("evalMemoryLimit") != 0 && json["evalMemoryLimit"].is_number_integer()) {
+		evalMemoryLimit = json["evalMemoryLimit"];
+	}
+	if (json.count("lazyStacks") != 0 && json["lazyStacks"].is_boolean()) {
+		lazyStacks = json["lazyStacks"];
+	}
+	if (json.count("expandChunkSize") != 0 && json["expandChunkSize"].is_number_integer()) {
+		expandChunkSize = json["expandChunkSize"];
+	}
+	if (json.count("expandTimeBudget") != 0 && json["expandTimeBudget"].is_number_integer()) {
+		expandTimeBudget = json["expandTimeBudget"];
+	}
+	if (json.count("tableChildrenLimit") != 0 && json["tableChildrenLimit"].is_number_integer()) {
+		tableChildrenLimit = json["tableChildrenLimit"];
+	}
+	if (json.count("weakCache") != 0 && json["weakCache"].is_boolean()) {
+		weakCache = json["weakCache"];
+	}
 }
 
 nlohmann::json BreakPoint::Serialize() {
@@ -111,37 +134,190 @@ void ActionParams::Deserialize(nlohmann::json json) {
 }
 
 Variable::Variable()
-	: nameType(LUA_TSTRING),
-	  valueType(0),
-	  cacheId(0) {
+	: _arena(nullptr),
+	  _id(0) {
+}
+
+Variable::Variable(VariableArena *arena, uint32_t id)
+	: _arena(arena),
+	  _id(id) {
+}
+
+VariableArena *Variable::GetArena() const {
+	return _arena;
+}
+
+const char *Variable::GetName() const {
+	auto name = _arena->_name[_id];
+	return name ? name : "";
+}
+
+void Variable::SetName(const char *name) {
+	_arena->_name[_id] = _arena->_strings.Store(name, strlen(name));
+}
+
+void Variable::SetName(const char *name, std::size_t size) {
+	_arena->_name[_id] = _arena->_strings.Store(name, size);
+}
+
+void Variable::SetName(const std::string &name) {
+	_arena->_name[_id] = _arena->_strings.Store(name);
+}
+
+int Variable::GetNameType() const {
+	return _arena->_nameType[_id];
+}
+
+void Variable::SetNameType(int type) {
+	_arena->_nameType[_id] = type;
+}
+
+const char *Variable::GetValue() const {
+	auto value = _arena->_value[_id];
+	return value ? value : "";
+}
+
+void Variable::SetValue(const char *value) {
+	_arena->_value[_id] = _arena->_strings.Store(value, strlen(value));
+}
+
+void Variable::SetValue(const char *value, std::size_t size) {
+	_arena->_value[_id] = _arena->_strings.Store(value, size);
+}
+
+void Variable::SetValue(const std::string &value) {
+	_arena->_value[_id] = _arena->_strings.Store(value);
+}
+
+int Variable::GetValueType() const {
+	return _arena->_valueType[_id];
+}
+
+void Variable::SetValueType(int type) {
+	_arena->_valueType[_id] = type;
+}
+
+const char *Variable::GetValueTypeName() const {
+	auto typeName = _arena->_valueTypeName[_id];
+	return typeName ? typeName : "";
+}
+
+void Variable::SetValueTypeName(const char *typeName) {
+	_arena->_valueTypeName[_id] = _arena->_strings.Store(typeName, strlen(typeName));
 }
 
-nlohmann::json Variable::Serialize() {
+int64_t Variable::GetCacheId() const {
+	return _arena->_cacheId[_id];
+}
+
+void Variable::SetCacheId(int64_t id) {
+	_arena->_cacheId[_id] = id;
+}
+
+bool Variable::IsTruncated() const {
+	return (_arena->_flags[_id] & VariableArena::Truncated) != 0;
+}
+
+void Variable::SetTruncated(bool truncated) {
+	auto &flags = _arena->_flags[_id];
+	if (truncated) {
+		flags |= VariableArena::Truncated;
+	} else {
+		flags &= ~VariableArena::Truncated;
+	}
+}
+
+void Variable::AddChild(Variable child) {
+	if (child._arena != _arena || child._id == _id) {
+		return;
+	}
+	auto &childFlags = _arena->_flags[child._id];
+	if (childFlags & VariableArena::Linked) {
+		return;
+	}
+	childFlags |= VariableArena::Linked;
+	auto &last = _arena->_lastChild[_id];
+	if (last == VariableArena::NoChild) {
+		_arena->_firstChild[_id] = child._id;
+	} else {
+		_arena->_nextSibling[last] = child._id;
+	}
+	last = child._id;
+}
+
+bool Variable::HasChildren() const {
+	return _arena->_firstChild[_id] != VariableArena::NoChild;
+}
+
+nlohmann::json Variable::Serialize() const {
 	auto obj = nlohmann::json::object();
-	obj["name"] = name;
-	obj["nameType"] = nameType;
-	obj["value"] = value;
-	obj["valueType"] = valueType;
-	obj["valueTypeName"] = valueTypeName;
-	obj["cacheId"] = cacheId;
+	obj["name"] = GetName();
+	obj["nameType"] = GetNameType();
+	obj["value"] = GetValue();
+	obj["valueType"] = GetValueType();
+	obj["valueTypeName"] = GetValueTypeName();
+	obj["cacheId"] = GetCacheId();
 
 	// children
-	if (!children.empty()) {
+	if (HasChildren()) {
 		auto arr = nlohmann::json::array();
-		for (auto idx: children) {
-			arr.push_back(idx->Serialize());
+		for (auto id = _arena->_firstChild[_id]; id != VariableArena::NoChild; id = _arena->_nextSibling[id]) {
+			arr.push_back(Variable(_arena, id).Serialize());
 		}
 		obj["children"] = arr;
 	}
+	if (IsTruncated()) {
+		obj["truncated"] = true;
+	}
 	return obj;
 }
 
-void Variable::Deserialize(nlohmann::json json) {
-	JsonProtocol::Deserialize(json);
+Variable VariableArena::Alloc() {
+	const auto id = _nameType.Push();
+	_valueType.Push();
+	_cacheId.Push();
+	_flags.Push();
+	_firstChild.Push();
+	_lastChild.Push();
+	_nextSibling.Push();
+	_name.Push();
+	_value.Push();
+	_valueTypeName.Push();
+
+	// 复用的段中留有上一次的值
+	_nameType[id] = LUA_TSTRING;
+	_valueType[id] = 0;
+	_cacheId[id] = 0;
+	_flags[id] = 0;
+	_firstChild[id] = NoChild;
+	_lastChild[id] = NoChild;
+	_nextSibling[id] = NoChild;
+	_name[id] = nullptr;
+	_value[id] = nullptr;
+	_valueTypeName[id] = nullptr;
+	return Variable(this, id);
+}
+
+void VariableArena::Clear() {
+	_nameType.Clear();
+	_valueType.Clear();
+	_cacheId.Clear();
+	_flags.Clear();
+	_firstChild.Clear();
+	_lastChild.Clear();
+	_nextSibling.Clear();
+	_name.Clear();
+	_value.Clear();
+	_valueTypeName.Clear();
+	_strings.Clear();
+}
+
+StringPool &VariableArena::GetStringPool() {
+	return _strings;
 }
 
 Stack::Stack()
-	: level(0), line(0), variableArena(std::make_shared<Arena<Variable>>()) {
+	: level(0), line(0) {
 }
 
 nlohmann::json Stack::Serialize() {
@@ -151,10 +327,13 @@ nlohmann::json Stack::Serialize() {
 	stackJson["functionName"] = functionName;
 	stackJson["line"] = line;
 	stackJson["level"] = level;
+	if (!hasVariables) {
+		return stackJson;
+	}
 	{
 		auto arr = nlohmann::json::array();
 		for (auto idx: localVariables) {
-			arr.push_back(idx->Serialize());
+			arr.push_back(idx.Serialize());
 		}
 		stackJson["localVariables"] = arr;
 	}
@@ -162,7 +341,7 @@ nlohmann::json Stack::Serialize() {
 	{
 		auto arr = nlohmann::json::array();
 		for (auto idx: upvalueVariables) {
-			arr.push_back(idx->Serialize());
+			arr.push_back(idx.Serialize());
 		}
 		stackJson["upvalueVariables"] = arr;
 	}
@@ -174,8 +353,26 @@ void Stack::Deserialize(nlohmann::json json) {
 	JsonProtocol::Deserialize(json);
 }
 
-EvalContext::EvalContext() {
-	result = _arena.Alloc();
+EvalContext::EvalContext()
+	: EvalContext(std::make_shared<VariableArena>()) {
+}
+
+EvalContext::EvalContext(std::shared_ptr<VariableArena> arena)
+	: _arena(arena) {
+	result = _arena->Alloc();
+}
+
+void EvalContext::Reset() {
+	expr.clear();
+	value.clear();
+	error.clear();
+	seq = 0;
+	stackLevel = 0;
+	depth = 0;
+	cacheId = 0;
+	result = _arena->Alloc();
+	success = false;
+	setValue = false;
 }
 
 nlohmann::json EvalContext::Serialize() {
@@ -184,7 +381,7 @@ nlohmann::json EvalContext::Serialize() {
 	obj["success"] = success;
 
 	if (success) {
-		obj["value"] = result->Serialize();
+		obj["value"] = result.Serialize();
 	} else {
 		obj["error"] = error;
 	}
@@ -214,7 +411,7 @@ void EvalContext::Deserialize(nlohmann::json json) {
 		depth = json["depth"];
 	}
 	if (json.count("cacheId") != 0 && json["cacheId"].is_number_integer()) {
-		cacheId = json["cacheId"];
+		cacheId = json["cacheId"].get<int64_t>();
 	}
 
 }
@@ -227,3 +424,159 @@ void EvalParams::Deserialize(nlohmann::json json) {
 	ctx = std::make_shared<EvalContext>();
 	ctx->Deserialize(json);
 }
+
+nlohmann::json BatchEvalContext::Serialize() {
+	auto obj = nlohmann::json::object();
+	obj["seq"] = seq;
+	auto results = nlohmann::json::array();
+	for (auto &eval: evals) {
+		results.push_back(eval->Serialize());
+	}
+	obj["results"] = results;
+	return obj;
+}
+
+void BatchEvalContext::Deserialize(nlohmann::json json) {
+	if (json.count("seq") != 0 && json["seq"].is_number_integer()) {
+		seq = json["seq"];
+	}
+	if (json.count("stackLevel") != 0 && json["stackLevel"].is_number_integer()) {
+		stackLevel = json["stackLevel"];
+	}
+	if (json.count("depth") != 0 && json["depth"].is_number_integer()) {
+		depth = json["depth"];
+	}
+
+	if (json.count("evals") != 0 && json["evals"].is_array()) {
+		auto arena = std::make_shared<VariableArena>();
+		for (auto &item: json["evals"]) {
+			auto eval = std::make_shared<EvalContext>(arena);
+			eval->depth = depth;
+			if (item.is_string()) {
+				eval->expr = item;
+			} else if (item.is_object()) {
+				eval->Deserialize(item);
+			} else {
+				continue;
+			}
+			eval->stackLevel = stackLevel;
+			evals.push_back(eval);
+		}
+	}
+}
+
+nlohmann::json StackVariablesContext::Serialize() {
+	auto obj = nlohmann::json::object();
+	obj["seq"] = seq;
+	obj["success"] = success;
+	if (success) {
+		obj["stack"] = stack.Serialize();
+	}
+	return obj;
+}
+
+void StackVariablesContext::Deserialize(nlohmann::json json) {
+	if (json.count("seq") != 0 && json["seq"].is_number_integer()) {
+		seq = json["seq"];
+	}
+	if (json.count("stackLevel") != 0 && json["stackLevel"].is_number_integer()) {
+		stackLevel = json["stackLevel"];
+	}
+}
+
+nlohmann::json StackVariablesParams::Serialize() {
+	return JsonProtocol::Serialize();
+}
+
+void StackVariablesParams::Deserialize(nlohmann::json json) {
+	ctx = std::make_shared<StackVariablesContext>();
+	ctx->Deserialize(json);
+}
+
+VariableArena *ExpandVariableContext::GetArena() {
+	return &_arena;
+}
+
+void ExpandVariableContext::ClearChunk() {
+	children.clear();
+	_arena.Clear();
+}
+
+nlohmann::json ExpandVariableContext::Serialize() {
+	auto obj = nlohmann::json::object();
+	obj["seq"] = seq;
+	obj["success"] = success;
+	obj["done"] = done;
+	if (!success) {
+		obj["error"] = error;
+		return obj;
+	}
+	obj["arraySize"] = arraySize;
+	obj["arrayOffset"] = chunkArrayOffset;
+	obj["hashOffset"] = chunkHashOffset;
+	auto arr = nlohmann::json::array();
+	for (auto idx: children) {
+		arr.push_back(idx.Serialize());
+	}
+	obj["children"] = arr;
+	return obj;
+}
+
+void ExpandVariableContext::Deserialize(nlohmann::json json) {
+	if (json.count("seq") != 0 && json["seq"].is_number_integer()) {
+		seq = json["seq"];
+	}
+	if (json.count("cacheId") != 0 && json["cacheId"].is_number_integer()) {
+		cacheId = json["cacheId"].get<int64_t>();
+	}
+	if (json.count("depth") != 0 && json["depth"].is_number_integer()) {
+		depth = json["depth"];
+	}
+	if (json.count("arrayOffset") != 0 && json["arrayOffset"].is_number_integer()) {
+		arrayOffset = json["arrayOffset"];
+	}
+	if (json.count("arrayLimit") != 0 && json["arrayLimit"].is_number_integer()) {
+		arrayLimit = json["arrayLimit"];
+	}
+	if (json.count("hashOffset") != 0 && json["hashOffset"].is_number_integer()) {
+		hashOffset = json["hashOffset"];
+	}
+	if (json.count("hashLimit") != 0 && json["hashLimit"].is_number_integer()) {
+		hashLimit = json["hashLimit"];
+	}
+}
+
+nlohmann::json ExpandVariableParams::Serialize() {
+	return JsonProtocol::Serialize();
+}
+
+void ExpandVariableParams::Deserialize(nlohmann::json json) {
+	ctx = std::make_shared<ExpandVariableContext>();
+	ctx->Deserialize(json);
+}
+
+nlohmann::json SetWatchesParams::Serialize() {
+	return JsonProtocol::Serialize();
+}
+
+void SetWatchesParams::Deserialize(nlohmann::json json) {
+	if (json.count("depth") != 0 && json["depth"].is_number_integer()) {
+		depth = json["depth"];
+	}
+	if (json.count("watches") != 0 && json["watches"].is_array()) {
+		for (auto &watch: json["watches"]) {
+			if (watch.is_string()) {
+				watches.push_back(watch);
+			}
+		}
+	}
+}
+
+nlohmann::json BatchEvalParams::Serialize() {
+	return JsonProtocol::Serialize();
+}
+
+void BatchEvalParams::Deserialize(nlohmann::json json) {
+	ctx = std::make_shared<BatchEvalContext>();
+	ctx->Deserialize(json);
+}
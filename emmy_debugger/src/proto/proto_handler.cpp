@@ -45,6 +45,34 @@ void ProtoHandler::OnDispatch(nlohmann::json document) {
 				OnEvalReq(params);
 				break;
 			}
+			case MessageCMD::HitCountReq: {
+				OnHitCountReq();
+				break;
+			}
+			case MessageCMD::BatchEvalReq: {
+				BatchEvalParams params;
+				params.Deserialize(document);
+				OnBatchEvalReq(params);
+				break;
+			}
+			case MessageCMD::SetWatchesReq: {
+				SetWatchesParams params;
+				params.Deserialize(document);
+				OnSetWatchesReq(params);
+				break;
+			}
+			case MessageCMD::StackVariablesReq: {
+				StackVariablesParams params;
+				params.Deserialize(document);
+				OnStackVariablesReq(params);
+				break;
+			}
+			case MessageCMD::ExpandVariableReq: {
+				ExpandVariableParams params;
+				params.Deserialize(document);
+				OnExpandVariableReq(params);
+				break;
+			}
 			default:
 				break;
 		}
@@ -86,3 +114,27 @@ void ProtoHandler::OnEvalReq(EvalParams &params) {
 	auto &manager = _owner->GetDebugManager();
 	manager.Eval(params.ctx);
 }
+
+void ProtoHandler::OnHitCountReq() {
+	_owner->HitCountReq();
+}
+
+void ProtoHandler::OnBatchEvalReq(BatchEvalParams &params) {
+	auto &manager = _owner->GetDebugManager();
+	manager.BatchEval(params.ctx);
+}
+
+void ProtoHandler::OnSetWatchesReq(SetWatchesParams &params) {
+	auto &manager = _owner->GetDebugManager();
+	manager.SetWatches(params.watches, params.depth);
+}
+
+void ProtoHandler::OnStackVariablesReq(StackVariablesParams &params) {
+	auto &manager = _owner->GetDebugManager();
+	manager.StackVariables(params.ctx);
+}
+
+void ProtoHandler::OnExpandVariableReq(ExpandVariableParams &params) {
+	auto &manager = _owner->GetDebugManager();
+	manager.ExpandVariable(params.ctx);
+}